@@ -44,66 +44,402 @@ __asm__ __volatile__ ("cld\n" \
 	:"=c" (__res):"c" (0),"S" (addr)); \
 __res;})
 
-void free_block(int dev, int block)
+static inline unsigned long popcount(unsigned long w)
+{
+	w -= (w >> 1) & 0x55555555;
+	w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+	w = (w + (w >> 4)) & 0x0f0f0f0f;
+	return (w * 0x01010101) >> 24;
+}
+
+/*
+ * count_free() counts the clear bits among the first 'bits' bits of
+ * an inode- or zone-map. It's only used at mount time: after that the
+ * counts in the super-block are kept up to date by the routines below.
+ */
+unsigned long count_free(struct buffer_head ** map, unsigned long bits)
+{
+	unsigned long free = 0;
+	unsigned long * p;
+	int i,n;
+
+	for (i=0 ; i<8 && bits ; i++) {
+		if (!map[i])
+			break;
+		n = (bits > 8192) ? 8192 : bits;
+		bits -= n;
+		p = (unsigned long *) map[i]->b_data;
+		for ( ; n >= 32 ; n -= 32, p++)
+			if (~*p)
+				free += popcount(~*p);
+		if (n)
+			free += popcount(~*p & ((1UL<<n)-1));
+	}
+	return free;
+}
+
+#define map_busy(map,bit) \
+(((unsigned long *) (map))[(bit)>>5] & (1UL << ((bit)&31)))
+
+/*
+ * The maps of a group filesystem are one zone-map and one inode-map block
+ * per group, read as they are needed, and the free counts are kept in the
+ * group descriptors too. Nothing sleeps between the bread() of a map and
+ * the setting of the bits in it.
+ */
+static struct buffer_head * grp_map(struct super_block * sb, int g, int zmap)
+{
+	struct grp_desc * d = group_desc(sb,g);
+
+	return bread(sb->s_dev,zmap ? d->g_zmap : d->g_imap);
+}
+
+static void grp_free_zone(struct super_block * sb, int zone)
 {
-	struct super_block * sb;
 	struct buffer_head * bh;
+	int g = zone / GRP_ZONES;
+
+	if (!(bh = grp_map(sb,g,1))) {
+		printk("block (%04x:%d) not freed: no zone-map\n\r",
+			sb->s_dev,zone);
+		return;
+	}
+	if (clear_bit(zone % GRP_ZONES,bh->b_data)) {
+		printk("block (%04x:%d) ",sb->s_dev,zone);
+		panic("free_block: bit already cleared");
+	}
+	bh->b_dirt = 1;
+	brelse(bh);
+	group_desc(sb,g)->g_free_zones++;
+	group_desc_dirt(sb,g);
+	sb->s_free_zones++;
+}
+
+/*
+ * grp_new_run() is new_block_run() for a group filesystem. The groups are
+ * searched from 'goal' on, wrapping round to the part of its group below
+ * it last, and a run never spans two groups, as each starts with its maps.
+ * The map with the best run is held while the others are read, and
+ * checked again before the run is taken.
+ */
+static int grp_new_run(struct super_block * sb, int goal, int * nr)
+{
+	struct buffer_head * bh, * best_bh;
+	int k,g,bit,end,len,start,best,best_len;
+
+repeat:
+	best_bh = NULL;
+	start = best = best_len = 0;
+	if (goal < 0 || goal >= sb->s_nzones)
+		goal = 0;
+	for (k=0 ; k <= sb->s_ngroups && best_len < *nr ; k++) {
+		if (k == sb->s_ngroups && !(goal%GRP_ZONES))
+			break;
+		g = (goal/GRP_ZONES + k) % sb->s_ngroups;
+		if (!group_desc(sb,g)->g_free_zones || !(bh = grp_map(sb,g,1)))
+			continue;
+		end = sb->s_nzones - g*GRP_ZONES;
+		if (end > GRP_ZONES)
+			end = GRP_ZONES;
+		if (k == sb->s_ngroups)
+			end = goal%GRP_ZONES;	/* wrapped round to goal */
+		for (len = 0, bit = k ? 0 : goal%GRP_ZONES ; bit < end ; bit++) {
+			if (!(bit & 31) && bit+32 <= end &&
+			    !~((unsigned long *) bh->b_data)[bit>>5]) {
+				len = 0;
+				bit += 31;
+				continue;
+			}
+			if (map_busy(bh->b_data,bit)) {
+				len = 0;
+				continue;
+			}
+			if (!len++)
+				start = bit;
+			if (len > best_len) {
+				if (best_bh != bh) {
+					brelse(best_bh);
+					best_bh = bh;
+					bh->b_count++;
+				}
+				best = g*GRP_ZONES + start;
+				best_len = len;
+				if (len >= *nr)
+					break;
+			}
+		}
+		brelse(bh);
+	}
+	if (!best_len)
+		return 0;
+	bit = best % GRP_ZONES;
+	for (len=0 ; len < best_len && !map_busy(best_bh->b_data,bit+len) ; len++)
+		set_bit(bit+len,best_bh->b_data);
+	best_bh->b_dirt = 1;
+	brelse(best_bh);
+	if (!len)
+		goto repeat;	/* it was taken while we slept */
+	*nr = len;
+	g = best / GRP_ZONES;
+	group_desc(sb,g)->g_free_zones -= len;
+	group_desc_dirt(sb,g);
+	sb->s_free_zones -= len;
+	return best;
+}
+
+static int grp_new_inode(struct super_block * sb, struct m_inode * dir)
+{
+	struct buffer_head * bh;
+	int k,g,j;
+
+	for (k=0 ; k < sb->s_ngroups ; k++) {
+		g = ((dir->i_num-1)/sb->s_ipg + k) % sb->s_ngroups;
+		if (!group_desc(sb,g)->g_free_inodes || !(bh = grp_map(sb,g,0)))
+			continue;
+		j = find_first_zero(bh->b_data);
+		if (j < sb->s_ipg && !set_bit(j,bh->b_data)) {
+			bh->b_dirt = 1;
+			brelse(bh);
+			group_desc(sb,g)->g_free_inodes--;
+			group_desc_dirt(sb,g);
+			return g*sb->s_ipg + j + 1;
+		}
+		brelse(bh);
+	}
+	return 0;
+}
+
+static void grp_free_inode(struct super_block * sb, int nr)
+{
+	struct buffer_head * bh;
+	int g = (nr-1) / sb->s_ipg;
+
+	if (!(bh = grp_map(sb,g,0))) {
+		printk("free_inode: no inode-map\n\r");
+		return;
+	}
+	if (clear_bit((nr-1) % sb->s_ipg,bh->b_data))
+		printk("free_inode: bit already cleared.\n\r");
+	else {
+		group_desc(sb,g)->g_free_inodes++;
+		group_desc_dirt(sb,g);
+		sb->s_free_inodes++;
+	}
+	bh->b_dirt = 1;
+	brelse(bh);
+}
+
+/*
+ * free_block() and new_block() work on zone numbers: zone z is the
+ * 1<<s_log_zone_size blocks starting at block z<<s_log_zone_size, and
+ * all of them are freed or cleared together.
+ */
+static int forget_zone(struct super_block * sb, int block)
+{
+	struct buffer_head * bh;
+	int i;
 
-	if (!(sb = get_super(dev)))
-		panic("trying to free block on nonexistent device");
 	if (block < sb->s_firstdatazone || block >= sb->s_nzones)
 		panic("trying to free block not in datazone");
-	bh = get_hash_table(dev,block);
-	if (bh) {
+	for (i=0 ; i < (1<<sb->s_log_zone_size) ; i++) {
+		bh = get_hash_table(sb->s_dev,(block<<sb->s_log_zone_size)+i);
+		if (!bh)
+			continue;
 		if (bh->b_count != 1) {
 			printk("trying to free block (%04x:%d), count=%d\n",
-				dev,block,bh->b_count);
-			return;
+				sb->s_dev,block,bh->b_count);
+			return -1;
 		}
 		bh->b_dirt=0;
 		bh->b_uptodate=0;
 		brelse(bh);
 	}
+	return 0;
+}
+
+void free_block(int dev, int block)
+{
+	struct super_block * sb;
+
+	if (!(sb = get_super(dev)))
+		panic("trying to free block on nonexistent device");
+	if (IS_TMP(dev)) {
+		tmp_free_block(sb,block);
+		return;
+	}
+	if (forget_zone(sb,block))
+		return;
+	if (IS_GRP(sb)) {
+		grp_free_zone(sb,block);
+		return;
+	}
 	block -= sb->s_firstdatazone - 1 ;
 	if (clear_bit(block&8191,sb->s_zmap[block/8192]->b_data)) {
 		printk("block (%04x:%d) ",dev,block+sb->s_firstdatazone-1);
 		panic("free_block: bit already cleared");
 	}
 	sb->s_zmap[block/8192]->b_dirt = 1;
+	sb->s_free_zones++;
 }
 
-int new_block(int dev)
+/*
+ * free_blocks() frees the 'nr' zones in zone[], which are sorted, as
+ * truncate() does: the zones that share a word of the zone-map are
+ * cleared together, and counted with popcount().
+ */
+void free_blocks(int dev, unsigned long * zone, int nr)
+{
+	struct super_block * sb;
+	struct buffer_head * map;
+	unsigned long * p, mask;
+	int i,j,bit;
+
+	if (!(sb = get_super(dev)))
+		panic("trying to free block on nonexistent device");
+	if (IS_TMP(dev)) {
+		for (i=0 ; i<nr ; i++)
+			tmp_free_block(sb,zone[i]);
+		return;
+	}
+	if (IS_GRP(sb)) {
+		for (i=0 ; i<nr ; i++)
+			if (!forget_zone(sb,zone[i]))
+				grp_free_zone(sb,zone[i]);
+		return;
+	}
+	for (i=0 ; i<nr ; i=j) {
+		bit = zone[i] - (sb->s_firstdatazone - 1);
+		mask = 0;
+		for (j=i ; j<nr && (zone[j] - (sb->s_firstdatazone - 1)) >> 5 ==
+		     bit >> 5 ; j++)
+			if (!forget_zone(sb,zone[j]))
+				mask |= 1UL << ((zone[j] - (sb->s_firstdatazone - 1)) & 31);
+		if (!mask)
+			continue;
+		map = sb->s_zmap[bit/8192];
+		p = ((unsigned long *) map->b_data) + ((bit&8191)>>5);
+		if ((*p & mask) != mask) {
+			printk("block (%04x:%d) ",dev,zone[i]);
+			panic("free_blocks: bit already cleared");
+		}
+		*p &= ~mask;
+		map->b_dirt = 1;
+		sb->s_free_zones += popcount(mask);
+	}
+}
+
+/* 'goal' is where to start looking, on a group filesystem */
+int new_block(int dev, int goal)
 {
 	struct buffer_head * bh;
 	struct super_block * sb;
-	int i,j;
+	int i,j,k;
 
 	if (!(sb = get_super(dev)))
 		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if ((bh=sb->s_zmap[i]))
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (i>=8 || !bh || j>=8192)
-		return 0;
-	if (set_bit(j,bh->b_data))
-		panic("new_block: bit already set");
-	bh->b_dirt = 1;
-	j += i*8192 + sb->s_firstdatazone-1;
-	if (j >= sb->s_nzones)
+	if (IS_TMP(dev))
+		return tmp_new_block(sb);
+	if (sb->s_free_zones <= sb->s_dalloc)
 		return 0;
-	if (!(bh=getblk(dev,j)))
-		panic("new_block: cannot get block");
-	if (bh->b_count != 1)
-		panic("new block: count is != 1");
-	clear_block(bh->b_data);
-	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
-	brelse(bh);
+	if (IS_GRP(sb)) {
+		i = 1;
+		if (!(j = grp_new_run(sb,goal,&i)))
+			return 0;
+	} else {
+		j = 8192;
+		for (i=0 ; i<8 ; i++)
+			if ((bh=sb->s_zmap[i]))
+				if ((j=find_first_zero(bh->b_data))<8192)
+					break;
+		if (i>=8 || !bh || j>=8192)
+			return 0;
+		if (j + i*8192 + sb->s_firstdatazone-1 >= sb->s_nzones)
+			return 0;
+		if (set_bit(j,bh->b_data))
+			panic("new_block: bit already set");
+		bh->b_dirt = 1;
+		sb->s_free_zones--;
+		j += i*8192 + sb->s_firstdatazone-1;
+	}
+	for (k=0 ; k < (1<<sb->s_log_zone_size) ; k++) {
+		if (!(bh=getblk(dev,(j<<sb->s_log_zone_size)+k)))
+			panic("new_block: cannot get block");
+		if (bh->b_count != 1)
+			panic("new block: count is != 1");
+		clear_block(bh->b_data);
+		bh->b_uptodate = 1;
+		bh->b_dirt = 1;
+		brelse(bh);
+	}
 	return j;
 }
 
+#define zone_busy(sb,bit) \
+(((unsigned long *) (sb)->s_zmap[(bit)>>13]->b_data)[((bit)&8191)>>5] & \
+	(1UL << ((bit)&31)))
+
+/*
+ * new_block_run() allocates up to *nr contiguous zones for delayed
+ * allocation. The search starts at 'goal', so that a file goes on where
+ * it left off, and takes the first free run that is long enough, or the
+ * longest one if there is none. *nr is set to the number of zones we got.
+ * Unlike new_block() the zones aren't cleared: the caller fills them.
+ */
+int new_block_run(int dev, int goal, int * nr)
+{
+	struct super_block * sb;
+	int bits,bit,i,len,start,best,best_len;
+
+	if (!(sb = get_super(dev)))
+		panic("trying to get new block from nonexistant device");
+	if (sb->s_free_zones <= sb->s_dalloc)
+		return 0;
+	if (*nr > sb->s_free_zones - sb->s_dalloc)
+		*nr = sb->s_free_zones - sb->s_dalloc;
+	if (IS_GRP(sb))
+		return grp_new_run(sb,goal,nr);
+	bits = sb->s_nzones - sb->s_firstdatazone + 1;
+	bit = goal - sb->s_firstdatazone + 1;
+	if (bit < 1 || bit >= bits)
+		bit = 1;
+	len = start = best = best_len = 0;
+	for (i = 1 ; i < bits ; i++, bit++) {
+		if (bit >= bits) {
+			bit = 1;
+			len = 0;
+		}
+		if (!(bit & 31) && bit+32 <= bits && !~((unsigned long *)
+		    sb->s_zmap[bit>>13]->b_data)[(bit&8191)>>5]) {
+			len = 0;
+			i += 31;
+			bit += 31;
+			continue;
+		}
+		if (zone_busy(sb,bit)) {
+			len = 0;
+			continue;
+		}
+		if (!len++)
+			start = bit;
+		if (len > best_len) {
+			best = start;
+			best_len = len;
+			if (len >= *nr)
+				break;
+		}
+	}
+	if (!best_len)
+		return 0;
+	*nr = best_len;
+	for (bit = best ; bit < best+best_len ; bit++) {
+		if (set_bit(bit&8191,sb->s_zmap[bit>>13]->b_data))
+			panic("new_block_run: bit already set");
+		sb->s_zmap[bit>>13]->b_dirt = 1;
+	}
+	sb->s_free_zones -= best_len;
+	return best + sb->s_firstdatazone - 1;
+}
+
 void free_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
@@ -125,44 +461,76 @@ void free_inode(struct m_inode * inode)
 		panic("trying to free inode on nonexistent device");
 	if (inode->i_num < 1 || inode->i_num > sb->s_ninodes)
 		panic("trying to free inode 0 or nonexistant inode");
+	if (IS_TMP(inode->i_dev)) {
+		tmp_free_inode(sb,inode->i_num);
+		sb->s_free_inodes++;
+		memset(inode,0,sizeof(*inode));
+		return;
+	}
+	if (IS_GRP(sb)) {
+		grp_free_inode(sb,inode->i_num);
+		memset(inode,0,sizeof(*inode));
+		return;
+	}
 	if (!(bh=sb->s_imap[inode->i_num>>13]))
 		panic("nonexistent imap in superblock");
 	if (clear_bit(inode->i_num&8191,bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
+	else
+		sb->s_free_inodes++;
 	bh->b_dirt = 1;
 	memset(inode,0,sizeof(*inode));
 }
 
-struct m_inode * new_inode(int dev)
+/* the new inode goes near its directory 'dir', on a group filesystem */
+struct m_inode * new_inode(struct m_inode * dir)
 {
 	struct m_inode * inode;
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int i,j;
+	int i,j,nr,dev = dir->i_dev;
 
 	if (!(inode=get_empty_inode()))
 		return NULL;
 	if (!(sb = get_super(dev)))
 		panic("new_inode with unknown device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if ((bh=sb->s_imap[i]))
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (!bh || j >= 8192 || j+i*8192 > sb->s_ninodes) {
+	if (!sb->s_free_inodes) {
 		iput(inode);
 		return NULL;
 	}
-	if (set_bit(j,bh->b_data))
-		panic("new_inode: bit already set");
-	bh->b_dirt = 1;
+	if (IS_TMP(dev)) {
+		if (!(nr = tmp_new_inode(sb))) {
+			iput(inode);
+			return NULL;
+		}
+	} else if (IS_GRP(sb)) {
+		if (!(nr = grp_new_inode(sb,dir))) {
+			iput(inode);
+			return NULL;
+		}
+	} else {
+		j = 8192;
+		for (i=0 ; i<8 ; i++)
+			if ((bh=sb->s_imap[i]))
+				if ((j=find_first_zero(bh->b_data))<8192)
+					break;
+		if (!bh || j >= 8192 || j+i*8192 > sb->s_ninodes) {
+			iput(inode);
+			return NULL;
+		}
+		if (set_bit(j,bh->b_data))
+			panic("new_inode: bit already set");
+		bh->b_dirt = 1;
+		nr = j + i*8192;
+	}
+	sb->s_free_inodes--;
 	inode->i_count=1;
 	inode->i_nlinks=1;
 	inode->i_dev=dev;
 	inode->i_uid=current->euid;
 	inode->i_gid=current->egid;
 	inode->i_dirt=1;
-	inode->i_num = j + i*8192;
+	inode->i_num = nr;
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
@@ -20,14 +20,19 @@ int block_write(int dev, long * pos, char * buf, int count)
 	struct buffer_head * bh;
 	register char * p;
 
+	if (IS_TMP(dev))
+		return -ENXIO;		/* no device behind it */
+	if (IS_CFS(dev))
+		return -EROFS;
 	while (count>0) {
 		chars = BLOCK_SIZE - offset;
 		if (chars > count)
 			chars=count;
-		if (chars == BLOCK_SIZE)
+		if (chars == BLOCK_SIZE) {
 			bh = getblk(dev,block);
-		else
-			bh = breada(dev,block,block+1,block+2,-1);
+			bh->b_uptodate = 1;
+		} else
+			bh = bread(dev,block);
 		block++;
 		if (!bh)
 			return written?written:-EIO;
@@ -36,8 +41,8 @@ int block_write(int dev, long * pos, char * buf, int count)
 		*pos += chars;
 		written += chars;
 		count -= chars;
-		while (chars-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,chars);
+		buf += chars;
 		bh->b_dirt = 1;
 		brelse(bh);
 	}
@@ -48,26 +53,42 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 {
 	int block = *pos >> BLOCK_SIZE_BITS;
 	int offset = *pos & (BLOCK_SIZE-1);
-	int chars;
+	int chars,i,n;
 	int read = 0;
-	struct buffer_head * bh;
+	int b[NR_MULTI];
+	struct buffer_head * bh[NR_MULTI];
 	register char * p;
 
+	if (IS_TMP(dev))
+		return -ENXIO;
 	while (count>0) {
-		chars = BLOCK_SIZE-offset;
-		if (chars > count)
-			chars = count;
-		if (!(bh = breada(dev,block,block+1,block+2,-1)))
-			return read?read:-EIO;
-		block++;
-		p = offset + bh->b_data;
-		offset = 0;
-		*pos += chars;
-		read += chars;
-		count -= chars;
-		while (chars-->0)
-			put_fs_byte(*(p++),buf++);
-		brelse(bh);
+		n = (offset + count + BLOCK_SIZE-1) >> BLOCK_SIZE_BITS;
+		if (n > NR_MULTI)
+			n = NR_MULTI;
+		for (i=0 ; i<n ; i++)
+			b[i] = block+i;
+		bread_multi(dev,b,n,bh);
+		if (!block)		/* block 0 looks like a hole to bread_multi */
+			bh[0] = bread(dev,0);
+		for (i=0 ; i<n ; i++) {
+			if (!bh[i]) {
+				while (++i < n)
+					brelse(bh[i]);
+				return read?read:-EIO;
+			}
+			chars = BLOCK_SIZE-offset;
+			if (chars > count)
+				chars = count;
+			p = offset + bh[i]->b_data;
+			offset = 0;
+			*pos += chars;
+			read += chars;
+			count -= chars;
+			memcpy_tofs(buf,p,chars);
+			buf += chars;
+			brelse(bh[i]);
+		}
+		block += n;
 	}
 	return read;
 }
@@ -19,6 +19,7 @@
  */
 
 #include <stdarg.h>
+#include <string.h>
  
 #include <linux/config.h>
 #include <linux/sched.h>
@@ -35,6 +36,19 @@ struct buffer_head * hash_table[NR_HASH];
 static struct buffer_head * free_list;
 static struct task_struct * buffer_wait = NULL;
 int NR_BUFFERS = 0;
+static int nr_dalloc = 0;
+
+/* at most this many delalloc buffers, so that getblk() always finds one */
+#define MAX_DALLOC (NR_BUFFERS/2)
+
+/*
+ * A tmpfs block is memory already (see tmpfs.c), so it gets one of these
+ * heads pointing right at it. They are never hashed or on the free list:
+ * they're always up to date, nobody ever writes them out, and a head is
+ * free again as soon as its count drops to 0.
+ */
+#define NR_TMP_BUFFERS 64
+static struct buffer_head tmp_buffer[NR_TMP_BUFFERS];
 
 static inline void wait_on_buffer(struct buffer_head * bh)
 {
@@ -49,11 +63,12 @@ int sys_sync(void)
 	int i;
 	struct buffer_head * bh;
 
+	sync_dalloc(0);		/* give delalloc buffers their blocks */
 	sync_inodes();		/* write out inodes into buffers */
 	bh = start_buffer;
 	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
 		wait_on_buffer(bh);
-		if (bh->b_dirt)
+		if (bh->b_dirt && !bh->b_dalloc)
 			ll_rw_block(WRITE,bh);
 	}
 	return 0;
@@ -69,7 +84,7 @@ int sync_dev(int dev)
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
+		if (bh->b_dev == dev && bh->b_dirt && !bh->b_dalloc)
 			ll_rw_block(WRITE,bh);
 	}
 	sync_inodes();
@@ -78,7 +93,7 @@ int sync_dev(int dev)
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
+		if (bh->b_dev == dev && bh->b_dirt && !bh->b_dalloc)
 			ll_rw_block(WRITE,bh);
 	}
 	return 0;
@@ -94,8 +109,15 @@ void inline invalidate_buffers(int dev)
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev)
-			bh->b_uptodate = bh->b_dirt = 0;
+		if (bh->b_dev != dev)
+			continue;
+		bh->b_uptodate = bh->b_dirt = 0;
+		if (bh->b_dalloc) {
+			bh->b_dalloc = 0;
+			bh->b_inode->i_dalloc--;
+			bh->b_inode = NULL;
+			nr_dalloc--;
+		}
 	}
 }
 
@@ -171,7 +193,17 @@ static struct buffer_head * find_buffer(int dev, int block)
 	struct buffer_head * tmp;
 
 	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next)
-		if (tmp->b_dev==dev && tmp->b_blocknr==block)
+		if (tmp->b_dev==dev && tmp->b_blocknr==block && !tmp->b_dalloc)
+			return tmp;
+	return NULL;
+}
+
+static struct buffer_head * find_dalloc(struct m_inode * inode, int block)
+{
+	struct buffer_head * tmp;
+
+	for (tmp = hash(inode->i_dev,block) ; tmp != NULL ; tmp = tmp->b_next)
+		if (tmp->b_dalloc && tmp->b_inode==inode && tmp->b_blocknr==block)
 			return tmp;
 	return NULL;
 }
@@ -187,6 +219,8 @@ struct buffer_head * get_hash_table(int dev, int block)
 {
 	struct buffer_head * bh;
 
+	if (IS_TMP(dev))
+		return NULL;	/* never dirty, nothing to invalidate */
 	for (;;) {
 		if (!(bh=find_buffer(dev,block)))
 			return NULL;
@@ -206,16 +240,20 @@ struct buffer_head * get_hash_table(int dev, int block)
  * The algoritm is changed: hopefully better, and an elusive bug removed.
  */
 #define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
-struct buffer_head * getblk(int dev,int block)
+
+/*
+ * get_free_buffer() finds an unused, clean buffer to recycle, or returns
+ * NULL if the one it picked got taken while it slept. Either way the caller
+ * has to check that nobody added its block to the cache in the meantime.
+ * Delalloc buffers are never recycled: they have nowhere to be written.
+ */
+static struct buffer_head * get_free_buffer(void)
 {
-	struct buffer_head * tmp, * bh;
+	struct buffer_head * tmp, * bh = NULL;
 
-repeat:
-	if ((bh = get_hash_table(dev,block)))
-		return bh;
 	tmp = free_list;
 	do {
-		if (tmp->b_count)
+		if (tmp->b_count || tmp->b_dalloc)
 			continue;
 		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
 			bh = tmp;
@@ -226,17 +264,64 @@ repeat:
 	} while ((tmp = tmp->b_next_free) != free_list);
 	if (!bh) {
 		sleep_on(&buffer_wait);
-		goto repeat;
+		return NULL;
 	}
 	wait_on_buffer(bh);
-	if (bh->b_count)
-		goto repeat;
+	if (bh->b_count || bh->b_dalloc)
+		return NULL;
 	while (bh->b_dirt) {
 		sync_dev(bh->b_dev);
 		wait_on_buffer(bh);
-		if (bh->b_count)
-			goto repeat;
+		if (bh->b_count || bh->b_dalloc)
+			return NULL;
+	}
+	return bh;
+}
+
+static struct buffer_head * getblk_tmp(int dev,int block)
+{
+	struct buffer_head * bh;
+
+	for (;;) {
+		for (bh = tmp_buffer ; bh < tmp_buffer+NR_TMP_BUFFERS ; bh++)
+			if (!bh->b_count) {
+				bh->b_count = 1;
+				bh->b_dev = dev;
+				bh->b_blocknr = block;
+				bh->b_data = (char *) (block << BLOCK_SIZE_BITS);
+				bh->b_uptodate = 1;
+				bh->b_dirt = 0;
+				return bh;
+			}
+		sleep_on(&buffer_wait);
 	}
+}
+
+/* wait until nobody has a block of the tmpfs page at 'addr' any more */
+void tmp_wait_page(unsigned long addr)
+{
+	struct buffer_head * bh;
+
+repeat:
+	for (bh = tmp_buffer ; bh < tmp_buffer+NR_TMP_BUFFERS ; bh++)
+		if (bh->b_count && ((unsigned long) bh->b_data &
+		    ~(PAGE_SIZE-1)) == addr) {
+			sleep_on(&buffer_wait);
+			goto repeat;
+		}
+}
+
+struct buffer_head * getblk(int dev,int block)
+{
+	struct buffer_head * bh;
+
+	if (IS_TMP(dev))
+		return getblk_tmp(dev,block);
+repeat:
+	if ((bh = get_hash_table(dev,block)))
+		return bh;
+	if (!(bh = get_free_buffer()))
+		goto repeat;
 /* NOTE!! While we slept waiting for this block, somebody else might */
 /* already have added "this" block to the cache. check it */
 	if (find_buffer(dev,block))
@@ -291,28 +376,47 @@ __asm__("cld\n\t" \
 	)
 
 /*
- * bread_page reads four buffers into memory at the desired address. It's
- * a function of its own, as there is some speed to be got by reading them
- * all at the same time, not waiting for one to be read, and then another
- * etc.
+ * bread_multi() reads 'nr' blocks at the same time: all the needed reads
+ * are started before we wait for any of them, so that the requests get
+ * sorted by the elevator and the drive doesn't idle between blocks. Zero
+ * block numbers (holes) and unreadable blocks give NULL buffers.
  */
-void bread_page(unsigned long address,int dev,int b[4])
+void bread_multi(int dev,int * b,int nr,struct buffer_head ** bh)
 {
-	struct buffer_head * bh[4];
 	int i;
 
-	for (i=0 ; i<4 ; i++)
+	for (i=0 ; i<nr ; i++)
 		if (b[i]) {
 			if ((bh[i] = getblk(dev,b[i])))
 				if (!bh[i]->b_uptodate)
 					ll_rw_block(READ,bh[i]);
 		} else
 			bh[i] = NULL;
-	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
+	for (i=0 ; i<nr ; i++)
 		if (bh[i]) {
 			wait_on_buffer(bh[i]);
-			if (bh[i]->b_uptodate)
-				COPYBLK((unsigned long) bh[i]->b_data,address);
+			if (!bh[i]->b_uptodate) {
+				brelse(bh[i]);
+				bh[i] = NULL;
+			}
+		}
+}
+
+/*
+ * bread_page reads four buffers into memory at the desired address. It's
+ * a function of its own, as there is some speed to be got by reading them
+ * all at the same time, not waiting for one to be read, and then another
+ * etc.
+ */
+void bread_page(unsigned long address,int dev,int b[4])
+{
+	struct buffer_head * bh[4];
+	int i;
+
+	bread_multi(dev,b,4,bh);
+	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
+		if (bh[i]) {
+			COPYBLK((unsigned long) bh[i]->b_data,address);
 			brelse(bh[i]);
 		}
 }
@@ -336,7 +440,7 @@ struct buffer_head * breada(int dev,int first, ...)
 		tmp=getblk(dev,first);
 		if (tmp) {
 			if (!tmp->b_uptodate)
-				ll_rw_block(READA,bh);
+				ll_rw_block(READA,tmp);
 			tmp->b_count--;
 		}
 	}
@@ -348,6 +452,278 @@ struct buffer_head * breada(int dev,int first, ...)
 	return (NULL);
 }
 
+/*
+ * The zones reserved for a delalloc buffer of logical block 'block': its
+ * zone, and one for each level of indirect block above it, in case it's
+ * the first to need them. Buffers that share an indirect block all
+ * reserve it, which is more than needed, never less.
+ */
+static int dalloc_cost(struct super_block * sb, int block)
+{
+	int zone = block >> sb->s_log_zone_size;
+
+	if (zone < 7)
+		return 1;
+	if (zone < 7+IND_ZONES(sb))
+		return 2;
+	return 3;
+}
+
+/*
+ * get_dalloc() returns the delalloc buffer for logical block 'block' of
+ * an inode, or NULL. Delalloc buffers are never locked, so there is
+ * nothing to wait for.
+ */
+struct buffer_head * get_dalloc(struct m_inode * inode, int block)
+{
+	struct buffer_head * bh;
+
+	if (!inode->i_dalloc || !(bh = find_dalloc(inode,block)))
+		return NULL;
+	bh->b_count++;
+	return bh;
+}
+
+/* flush all the delalloc buffers of the inode, see below */
+static struct buffer_head * no_dalloc(struct m_inode * inode)
+{
+	while (inode->i_dflush)
+		sleep_on(&inode->i_wait);
+	flush_dalloc(inode);
+	return NULL;
+}
+
+/*
+ * getblk_dalloc() returns a zeroed delalloc buffer for a block of a
+ * regular file that has no disk block, and reserves zones for it so that
+ * a full disk shows up at write() time and not at sync time: the data
+ * zone, and the indirect zones it may need (see dalloc_cost()). NULL
+ * means the block can't be delayed: it is already mapped, the disk is
+ * full, or there are too many delalloc buffers. The caller then uses
+ * create_block(), so in the last two cases the delalloc buffers of the
+ * inode are flushed first: the zone of the block mustn't have any left
+ * once it is mapped. A flush that is already running (fsync) isn't
+ * enough, as it may have passed this zone, so we wait for it to finish.
+ *
+ * The free buffer is taken first, as that may sleep. Once bmap() has
+ * returned nothing sleeps until the buffer is a delalloc buffer, so
+ * nobody can map the block behind our back. The one call that sleeps
+ * after it, flush_dalloc() when the disk is full, comes after the
+ * buffer has been given back, and we return NULL.
+ */
+struct buffer_head * getblk_dalloc(struct m_inode * inode, int block)
+{
+	struct super_block * sb;
+	struct buffer_head * bh, * tmp;
+
+	if ((bh = get_dalloc(inode,block)))
+		return bh;
+	if (IS_TMP(inode->i_dev))
+		return NULL;	/* no disk to delay anything for */
+	if (!(sb = get_super(inode->i_dev)))
+		panic("getblk_dalloc: no super-block");
+	if (nr_dalloc >= MAX_DALLOC) {
+		sync_dalloc(0);
+		if (nr_dalloc >= MAX_DALLOC)
+			return no_dalloc(inode);
+	}
+	while (!(bh = get_free_buffer()))
+		/* nothing */ ;
+	bh->b_count = 1;
+	remove_from_queues(bh);
+	bh->b_dev = 0;
+	bh->b_dirt = bh->b_uptodate = 0;
+	insert_into_queues(bh);
+	if (bmap(inode,block)) {
+		brelse(bh);
+		return NULL;
+	}
+	if ((tmp = find_dalloc(inode,block))) {
+		brelse(bh);
+		tmp->b_count++;
+		return tmp;
+	}
+	if (sb->s_free_zones < sb->s_dalloc + dalloc_cost(sb,block)) {
+		brelse(bh);
+		return no_dalloc(inode);
+	}
+	sb->s_dalloc += dalloc_cost(sb,block);
+	inode->i_dalloc++;
+	nr_dalloc++;
+	remove_from_queues(bh);
+	bh->b_dev = inode->i_dev;
+	bh->b_blocknr = block;
+	bh->b_dalloc = 1;
+	bh->b_inode = inode;
+	insert_into_queues(bh);
+	memset(bh->b_data,0,BLOCK_SIZE);
+	bh->b_uptodate = 1;
+	bh->b_dirt = 1;
+	return bh;
+}
+
+/*
+ * undalloc() turns a delalloc buffer into an ordinary dirty buffer for
+ * disk block 'block', or throws it away if 'block' is 0. A stale buffer
+ * for the same block (left over from when it was last freed) is dropped.
+ */
+static void undalloc(struct buffer_head * bh, int block)
+{
+	struct buffer_head * tmp;
+
+	if (block && (tmp = find_buffer(bh->b_dev,block))) {
+		remove_from_queues(tmp);
+		tmp->b_dev = 0;
+		tmp->b_uptodate = tmp->b_dirt = 0;
+		insert_into_queues(tmp);
+	}
+	remove_from_queues(bh);
+	bh->b_inode->i_dalloc--;
+	nr_dalloc--;
+	bh->b_dalloc = 0;
+	bh->b_inode = NULL;
+	if (!(bh->b_blocknr = block)) {
+		bh->b_dev = 0;
+		bh->b_uptodate = bh->b_dirt = 0;
+	}
+	insert_into_queues(bh);
+	wake_up(&buffer_wait);
+}
+
+static void drop_unused(struct m_inode * inode, struct super_block * sb)
+{
+	struct buffer_head * bh;
+	int i;
+
+	bh = start_buffer;
+	for (i=0 ; i<NR_BUFFERS ; i++,bh++)
+		if (bh->b_dalloc && bh->b_inode == inode && !bh->b_count) {
+			sb->s_dalloc -= dalloc_cost(sb,bh->b_blocknr);
+			undalloc(bh,0);
+		}
+}
+
+static int first_dalloc(struct m_inode * inode)
+{
+	struct buffer_head * bh;
+	int i,block = -1;
+
+	bh = start_buffer;
+	for (i=0 ; i<NR_BUFFERS ; i++,bh++)
+		if (bh->b_dalloc && bh->b_inode == inode &&
+		    (block < 0 || bh->b_blocknr < block))
+			block = bh->b_blocknr;
+	if (block < 0)
+		panic("flush_dalloc: lost delalloc buffers");
+	return block;
+}
+
+/* the number of delalloc buffers in zone 'zone' of the file */
+static int zone_dalloc(struct m_inode * inode, int zone, int shift)
+{
+	int i,n = 0;
+
+	for (i=0 ; i < (1<<shift) ; i++)
+		if (find_dalloc(inode,(zone<<shift)+i))
+			n++;
+	return n;
+}
+
+/*
+ * flush_dalloc() gives disk blocks to the delalloc buffers of an inode.
+ * Each run of consecutive file zones that have delalloc buffers in them
+ * gets a run of consecutive disk zones, right after the zone before it
+ * if possible. The buffers then are ordinary dirty buffers, written out
+ * by the next sync; the other blocks of those zones are zeroed. A zone
+ * that is mapped never has delalloc buffers, see getblk_dalloc().
+ */
+void flush_dalloc(struct m_inode * inode)
+{
+	struct super_block * sb;
+	struct buffer_head * bh;
+	int block,zone,goal,shift,n,r,i,j,k;
+
+	if (!inode->i_dalloc || inode->i_dflush)
+		return;
+	if (!(sb = get_super(inode->i_dev)))
+		panic("flush_dalloc: no super-block");
+	shift = sb->s_log_zone_size;
+	inode->i_dflush = 1;
+	while (inode->i_dalloc) {
+		block = first_dalloc(inode) >> shift;
+		r = zone_dalloc(inode,block,shift) *
+			dalloc_cost(sb,block<<shift);
+		for (n=1 ; (k = zone_dalloc(inode,block+n,shift)) ; n++)
+			r += k * dalloc_cost(sb,(block+n)<<shift);
+		if ((goal = block ? bmap(inode,(block<<shift)-1) : 0))
+			goal = (goal>>shift)+1;
+		else
+			goal = zone_goal(inode);
+		i = n;
+		sb->s_dalloc -= r;
+		if (!(zone = new_block_run(inode->i_dev,goal,&i)))
+			i = 0;
+		for (j=0 ; j<i ; j++) {
+			if (map_block(inode,(block+j)<<shift,zone+j) !=
+			    (zone+j)<<shift)
+				break;
+			for (k=0 ; k < (1<<shift) ; k++)
+				if ((bh = find_dalloc(inode,((block+j)<<shift)+k))) {
+					undalloc(bh,((zone+j)<<shift)+k);
+					r -= dalloc_cost(sb,(block+j)<<shift);
+				}
+			for (k=0 ; shift && k < (1<<shift) ; k++) {
+				bh = getblk(inode->i_dev,((zone+j)<<shift)+k);
+				if (!bh->b_uptodate) {
+					memset(bh->b_data,0,BLOCK_SIZE);
+					bh->b_uptodate = 1;
+					bh->b_dirt = 1;
+				}
+				brelse(bh);
+			}
+		}
+		sb->s_dalloc += r;
+		if (!i || j < i) {
+			while (j < i)
+				free_block(inode->i_dev,zone+j++);
+			printk("dev %04x: no room for delayed blocks\n\r",
+				inode->i_dev);
+			drop_unused(inode,sb);
+			break;
+		}
+	}
+	inode->i_dflush = 0;
+	wake_up(&inode->i_wait);
+}
+
+/*
+ * drop_dalloc() is used by truncate: the delalloc buffers of the inode
+ * are just thrown away, without ever touching the bitmaps. Buffers that
+ * somebody is still writing into are left alone.
+ */
+void drop_dalloc(struct m_inode * inode)
+{
+	struct super_block * sb;
+
+	while (inode->i_dflush)
+		sleep_on(&inode->i_wait);
+	if (!inode->i_dalloc)
+		return;
+	if (!(sb = get_super(inode->i_dev)))
+		panic("drop_dalloc: no super-block");
+	drop_unused(inode,sb);
+}
+
+/* flush the delalloc buffers of all inodes on 'dev' (0 - all devices) */
+void sync_dalloc(int dev)
+{
+	struct m_inode * inode;
+
+	for (inode = inode_table ; inode < inode_table+NR_INODE ; inode++)
+		if (inode->i_dalloc && (!dev || inode->i_dev == dev))
+			flush_dalloc(inode);
+}
+
 void buffer_init(long buffer_end)
 {
 	struct buffer_head * h = start_buffer;
@@ -364,7 +740,9 @@ void buffer_init(long buffer_end)
 		h->b_count = 0;
 		h->b_lock = 0;
 		h->b_uptodate = 0;
+		h->b_dalloc = 0;
 		h->b_wait = NULL;
+		h->b_inode = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
 		h->b_data = (char *) b;
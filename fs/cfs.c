@@ -0,0 +1,169 @@
+/*
+ *  linux/fs/cfs.c
+ */
+
+/*
+ * cfs lets a minix filesystem be kept compressed, read-only. The image
+ * (made by tools/mkcfs) holds the minix filesystem cut in chunks of
+ * CFS_CHUNK bytes, each compressed on its own. A chunk of zeroes takes
+ * no room at all, and one that doesn't get any smaller is stored as it
+ * is.
+ *
+ * The filesystem is reached through device CFS_MAJOR, whose minor names
+ * the device the image is on (see CFS_DEV()). It has no driver: when
+ * ll_rw_block() is asked to read one of its blocks, cfs_rw_block() reads
+ * the compressed chunk from the image device and decompresses it into
+ * the buffer cache, the other blocks of the chunk too. Nothing is ever
+ * written: opening a file or directory on cfs for writing, or changing
+ * a directory, fails with EROFS (device nodes still work), and a dirty
+ * buffer is just dropped.
+ *
+ * The compression is LZSS: each flag byte tells, low bit first, whether
+ * each of the next 8 items is a literal byte (1), or a match (0) of two
+ * bytes. With d the distance back - 1 (12 bits) and l the length - 3
+ * (4 bits), the first byte is the low 8 bits of d, and the second has
+ * the top 4 bits of d in its high nibble and l in its low nibble:
+ *
+ *	byte 0: d & 0xff
+ *	byte 1: ((d >> 8) << 4) | l
+ */
+
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+static char cfs_in[CFS_CHUNK];
+static char cfs_out[CFS_CHUNK];
+static int cfs_busy = 0;
+static struct task_struct * cfs_wait = NULL;
+
+/* read 'len' bytes at byte 'pos' of 'dev', which isn't in block 0 */
+static int read_bytes(int dev, unsigned long pos, char * buf, int len)
+{
+	struct buffer_head * bh[NR_MULTI];
+	int b[NR_MULTI];
+	int i,n,c,off,err = 0;
+
+	n = ((pos+len+BLOCK_SIZE-1) >> BLOCK_SIZE_BITS) - (pos >> BLOCK_SIZE_BITS);
+	if (pos < BLOCK_SIZE || n > NR_MULTI)
+		return -1;
+	for (i=0 ; i<n ; i++)
+		b[i] = (pos >> BLOCK_SIZE_BITS) + i;
+	bread_multi(dev,b,n,bh);
+	off = pos & (BLOCK_SIZE-1);
+	for (i=0 ; i<n ; i++) {
+		if (!bh[i]) {
+			err = -1;
+			continue;
+		}
+		c = BLOCK_SIZE-off;
+		if (c > len)
+			c = len;
+		memcpy(buf,bh[i]->b_data+off,c);
+		buf += c;
+		len -= c;
+		off = 0;
+		brelse(bh[i]);
+	}
+	return err;
+}
+
+static int lzss(char * in, int len, char * out)
+{
+	char * end = in+len;
+	int n = 0,flags = 0,bits = 0,dist,cnt;
+
+	while (n < CFS_CHUNK) {
+		if (!bits--) {
+			if (in >= end)
+				return -1;
+			flags = *in++ & 0xff;
+			bits = 7;
+		}
+		if (flags & 1) {
+			if (in >= end)
+				return -1;
+			out[n++] = *in++;
+		} else {
+			if (in+2 > end)
+				return -1;
+			dist = (((in[1] & 0xf0) << 4) | (in[0] & 0xff)) + 1;
+			cnt = (in[1] & 0x0f) + 3;
+			in += 2;
+			if (dist > n || n+cnt > CFS_CHUNK)
+				return -1;
+			for ( ; cnt ; cnt--,n++)
+				out[n] = out[n-dist];
+		}
+		flags >>= 1;
+	}
+	return 0;
+}
+
+/* decompress chunk 'chunk' of the image on 'dev' into cfs_out */
+static int read_chunk(int dev, int chunk)
+{
+	struct buffer_head * bh;
+	unsigned long off[2];
+	int len;
+
+	if (!(bh = bread(dev,0)))
+		return -1;
+	if (((struct cfs_header *) bh->b_data)->h_magic != CFS_MAGIC ||
+	    chunk >= ((struct cfs_header *) bh->b_data)->h_chunks) {
+		brelse(bh);
+		return -1;
+	}
+	brelse(bh);
+	if (read_bytes(dev,BLOCK_SIZE+chunk*4,(char *) off,8))
+		return -1;
+	len = off[1]-off[0];
+	if (!len) {
+		memset(cfs_out,0,CFS_CHUNK);
+		return 0;
+	}
+	if (len == CFS_CHUNK)
+		return read_bytes(dev,off[0],cfs_out,len);
+	if (len < 0 || len > CFS_CHUNK || read_bytes(dev,off[0],cfs_in,len))
+		return -1;
+	return lzss(cfs_in,len,cfs_out);
+}
+
+/*
+ * Called by ll_rw_block() for the blocks of a cfs device. The reads are
+ * done one at a time, as they share cfs_in and cfs_out, and before we
+ * return: read-ahead isn't worth it here.
+ */
+void cfs_rw_block(int rw, struct buffer_head * bh)
+{
+	struct buffer_head * tmp;
+	int first,i;
+
+	if (rw == WRITE || rw == WRITEA) {
+		bh->b_dirt = 0;		/* read-only */
+		return;
+	}
+	if (rw != READ)
+		return;
+	while (cfs_busy)
+		sleep_on(&cfs_wait);
+	cfs_busy = 1;
+	first = bh->b_blocknr & ~((1<<CFS_CHUNK_BITS)-1);
+	if (!bh->b_uptodate &&
+	    !read_chunk(CFS_DEV(bh->b_dev),bh->b_blocknr >> CFS_CHUNK_BITS))
+		for (i=0 ; i < (1<<CFS_CHUNK_BITS) ; i++) {
+			if (first+i == bh->b_blocknr)
+				tmp = bh;
+			else if (!(tmp = getblk(bh->b_dev,first+i)))
+				continue;
+			if (!tmp->b_uptodate) {
+				memcpy(tmp->b_data,cfs_out+i*BLOCK_SIZE,BLOCK_SIZE);
+				tmp->b_uptodate = 1;
+			}
+			if (tmp != bh)
+				brelse(tmp);
+		}
+	cfs_busy = 0;
+	wake_up(&cfs_wait);
+}
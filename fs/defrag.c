@@ -0,0 +1,237 @@
+/*
+ *  linux/fs/defrag.c
+ */
+
+/*
+ * defrag() moves the zones of an open file to runs of free zones that
+ * follow each other, up to DEFRAG_CHUNK zones at a time: the run is taken
+ * from the zone-map with new_block_run(), the data is copied through the
+ * buffer cache, and then the zone numbers in the inode or the indirect
+ * block are switched over, without sleeping in between, and the old
+ * zones freed. The indirect blocks themselves stay where they are.
+ *
+ * The file may be in use meanwhile. Writers and truncate() bump i_version
+ * as they start and finish and count themselves in i_writers, and the
+ * switch is only done if none of them ran during the copy and the zone
+ * numbers are still the ones that were copied. Otherwise the copy is
+ * thrown away and the chunk tried again.
+ *
+ * Readers may have looked up the old zones before the switch and still
+ * be reading them, so those aren't freed (and can't be handed out again)
+ * until every read that started before the switch is done. Reads count
+ * themselves in the generation that is current when they start, and the
+ * switch starts a new one, so new reads can't hold defrag() up for ever.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#define DEFRAG_CHUNK 64		/* zones moved at a time */
+#define DEFRAG_TRIES 8		/* times a busy chunk is tried */
+
+int read_start(struct m_inode * inode)
+{
+	int gen = inode->i_rgen;
+
+	inode->i_readers[gen]++;
+	return gen;
+}
+
+void read_end(struct m_inode * inode, int gen)
+{
+	if (!--inode->i_readers[gen])
+		wake_up(&inode->i_wait);
+}
+
+/* the slots in the inode are 32 bits, and on a group filesystem all are */
+#define SLOT(map,wide,i) ((wide) ? ((unsigned long *) (map))[i] : \
+	((unsigned short *) (map))[i])
+#define SET_SLOT(map,wide,i,zone) do { \
+	if (wide) ((unsigned long *) (map))[i] = (zone); \
+	else ((unsigned short *) (map))[i] = (zone); } while (0)
+
+/* the end of the run of zone slots (inode or indirect block) 'z' is in */
+static int slots_end(int z, int bits)
+{
+	int n = 1<<bits;
+
+	if (z < 7)
+		return 7;
+	if (z < 7+n)
+		return 7+n;
+	return 7+n + ((((z-7-n)>>bits)+1)<<bits);
+}
+
+/*
+ * zone_slots() finds the slot of zone 'z' of the file, and tells in *wide
+ * how big the slots there are. If it's in an indirect block, that stays in
+ * *bh until the caller lets it go.
+ */
+static void * zone_slots(struct m_inode * inode, int z, struct super_block * sb,
+	struct buffer_head ** bh, int * wide)
+{
+	struct buffer_head * dbh;
+	int i,shift = sb->s_log_zone_size,bits = IND_BITS(sb);
+
+	*bh = NULL;
+	*wide = 1;
+	if (z < 7)
+		return inode->i_zone + z;
+	*wide = IS_GRP(sb);
+	if (z < 7+(1<<bits)) {
+		if (!inode->i_zone[7] ||
+		    !(*bh = bread(inode->i_dev,inode->i_zone[7]<<shift)))
+			return NULL;
+		z -= 7;
+	} else {
+		z -= 7+(1<<bits);
+		if (!inode->i_zone[8] ||
+		    !(dbh = bread(inode->i_dev,inode->i_zone[8]<<shift)))
+			return NULL;
+		i = ind_zone(sb,dbh->b_data,z>>bits);
+		brelse(dbh);
+		if (!i || !(*bh = bread(inode->i_dev,i<<shift)))
+			return NULL;
+		z &= (1<<bits)-1;
+	}
+	return (*bh)->b_data + (z << (*wide ? 2 : 1));
+}
+
+/* copy the 'n' zones from[] to the zones starting at 'to' */
+static int copy_zones(int dev, unsigned long * from, int to, int n, int shift)
+{
+	struct buffer_head * bh[NR_MULTI], * nbh;
+	int b[NR_MULTI];
+	int i,k,done;
+
+	n <<= shift;
+	for (done=0 ; done<n ; done += k) {
+		k = n-done;
+		if (k > NR_MULTI)
+			k = NR_MULTI;
+		for (i=0 ; i<k ; i++)
+			b[i] = (from[(done+i)>>shift]<<shift) +
+				((done+i) & ((1<<shift)-1));
+		bread_multi(dev,b,k,bh);
+		for (i=0 ; i<k ; i++) {
+			if (!bh[i]) {
+				while (++i < k)
+					brelse(bh[i]);
+				return -EIO;
+			}
+			nbh = getblk(dev,(to<<shift)+done+i);
+			memcpy(nbh->b_data,bh[i]->b_data,BLOCK_SIZE);
+			nbh->b_uptodate = 1;
+			nbh->b_dirt = 1;
+			brelse(nbh);
+			brelse(bh[i]);
+		}
+	}
+	return 0;
+}
+
+int sys_defrag(unsigned int fd)
+{
+	unsigned long old[DEFRAG_CHUNK];
+	struct file * file;
+	struct m_inode * inode;
+	struct super_block * sb;
+	struct buffer_head * bh;
+	void * map;
+	unsigned short version;
+	int shift,last,goal,tries,contig,z,end,n,i,zone,err,wide,gen;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]) ||
+	    !(inode=file->f_inode))
+		return -EBADF;
+	if ((file->f_flags & O_ACCMODE) == O_RDONLY)
+		return -EBADF;
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (IS_TMP(inode->i_dev))
+		return 0;		/* memory is never fragmented */
+	if (!(sb = get_super(inode->i_dev)))
+		return -ENODEV;
+	flush_dalloc(inode);
+	shift = sb->s_log_zone_size;
+	last = (inode->i_size + (BLOCK_SIZE<<shift)-1) >> (BLOCK_SIZE_BITS+shift);
+	goal = tries = 0;
+	for (z=0 ; z<last ; z += n) {
+		version = inode->i_version;
+		end = slots_end(z,IND_BITS(sb));
+		if (!(map = zone_slots(inode,z,sb,&bh,&wide))) {
+			n = end-z;
+			continue;
+		}
+		if (end > last)
+			end = last;
+		if (end > z+DEFRAG_CHUNK)
+			end = z+DEFRAG_CHUNK;
+		for (n=0 ; z+n<end && SLOT(map,wide,n) ; n++)
+			old[n] = SLOT(map,wide,n);
+		if (!n) {
+			for (n=1 ; z+n<end && !SLOT(map,wide,n) ; n++)
+				/* skip the hole */ ;
+			brelse(bh);
+			continue;
+		}
+		for (i=1 ; i<n && old[i] == old[0]+i ; i++)
+			/* nothing */ ;
+		contig = (i == n);
+		if (contig && (!goal || old[0] == goal)) {
+			goal = old[0]+n;
+			brelse(bh);
+			continue;
+		}
+		i = n;
+		if (!(zone = new_block_run(inode->i_dev,goal,&i))) {
+			brelse(bh);
+			return -ENOSPC;
+		}
+		if (contig && (zone != goal || i < n)) {
+			/* it wouldn't be any better anywhere else */
+			while (i--)
+				free_block(inode->i_dev,zone+i);
+			goal = old[0]+n;
+			brelse(bh);
+			continue;
+		}
+		n = i;
+		err = copy_zones(inode->i_dev,old,zone,n,shift);
+		for (i=0 ; i<n && SLOT(map,wide,i) == old[i] ; i++)
+			/* nothing */ ;
+		if (err || i<n || version != inode->i_version || inode->i_writers) {
+			for (i=0 ; i<n ; i++)
+				free_block(inode->i_dev,zone+i);
+			brelse(bh);
+			if (err)
+				return err;
+			if (++tries > DEFRAG_TRIES)
+				return -EBUSY;
+			n = 0;
+			continue;
+		}
+		for (i=0 ; i<n ; i++)
+			SET_SLOT(map,wide,i,zone+i);
+		if (bh)
+			bh->b_dirt = 1;
+		else
+			inode->i_dirt = inode->i_ddirt = 1;
+		inode->i_version++;
+		brelse(bh);
+		gen = inode->i_rgen;
+		inode->i_rgen ^= 1;
+		while (inode->i_readers[gen])
+			sleep_on(&inode->i_wait);
+		for (i=0 ; i<n ; i++)
+			free_block(inode->i_dev,old[i]);
+		goal = zone+n;
+		tries = 0;
+	}
+	return 0;
+}
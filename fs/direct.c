@@ -0,0 +1,220 @@
+/*
+ *  linux/fs/direct.c
+ */
+
+/*
+ * O_DIRECT reads and writes of whole, aligned blocks go straight between
+ * the device and the user's pages: each request gets a private buffer
+ * head whose b_data is the physical address of the user memory, so the
+ * data is neither copied nor kept in the buffer cache. Cached copies of
+ * the blocks are written out before a direct read, and dropped around a
+ * direct write, so buffered readers and writers still see the same file.
+ *
+ * Anything that isn't aligned to BLOCK_SIZE (the file position, the user
+ * buffer or the count) just goes through the cache as usual.
+ *
+ * The pages are faulted in (and un-shared, when we write into them)
+ * before the requests are made. The process then sleeps until they are
+ * all done, and nobody else changes its page tables meanwhile.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+#include <asm/system.h>
+
+extern int block_read(int dev, off_t * pos, char * buf, int count);
+extern int block_write(int dev, off_t * pos, char * buf, int count);
+extern int file_read(struct m_inode * inode, struct file * filp,
+		char * buf, int count);
+extern int file_write(struct m_inode * inode, struct file * filp,
+		char * buf, int count);
+extern void file_zero(struct m_inode * inode, off_t from, off_t to);
+
+/* kernel buffers (sendfile, splice) always go through the cache */
+#define ALIGNED(pos,buf,count) (get_fs() != get_ds() && \
+!(((unsigned long) (pos) | (unsigned long) (buf) | (count)) & (BLOCK_SIZE-1)))
+
+static inline void wait_on_direct(struct buffer_head * bh)
+{
+	cli();
+	while (bh->b_lock)
+		sleep_on(&bh->b_wait);
+	sti();
+}
+
+/* the physical address of user address 'addr', whose page is present */
+static unsigned long user_phys(char * addr)
+{
+	unsigned long linear, * table;
+
+	linear = (unsigned long) addr + get_base(current->ldt[2]);
+	table = (unsigned long *) (0xfffff000 &
+		*((unsigned long *) ((linear >> 20) & 0xffc)));
+	return (0xfffff000 & table[(linear >> 12) & 0x3ff]) + (linear & 0xfff);
+}
+
+static void map_user(char * buf, int count, int writable)
+{
+	char * p;
+
+	for (p = buf ; p < buf+count ; p = (char *) (((long) p | 0xfff) + 1))
+		(void) get_fs_byte(p);
+	if (writable)
+		verify_area(buf,count);
+}
+
+/*
+ * direct_io() moves 'nr' blocks between the disk blocks b[] of 'dev' and
+ * the user buffer 'buf', one block per kilobyte. A negative block is a
+ * hole, which reads as zeroes. A run of consecutive blocks in the same
+ * user page is a single request, except on floppies, whose driver does
+ * one block at a time.
+ */
+static int direct_io(int rw, int dev, int * b, int nr, char * buf)
+{
+	struct buffer_head bh[NR_MULTI], * tmp;
+	int i,j,n,err = 0;
+
+	map_user(buf,nr*BLOCK_SIZE,rw == READ);
+	for (i=0 ; i<nr ; i++)
+		if (b[i] >= 0 && (tmp = get_hash_table(dev,b[i]))) {
+			if (rw == WRITE)
+				tmp->b_dirt = 0;
+			else if (tmp->b_dirt) {
+				ll_rw_block(WRITE,tmp);
+				wait_on_direct(tmp);
+			}
+			brelse(tmp);
+		}
+	for (i=n=0 ; i<nr ; i=j) {
+		j = i+1;
+		if (b[i] < 0) {
+			clear_fs(buf+i*BLOCK_SIZE,BLOCK_SIZE);
+			continue;
+		}
+		while (j<nr && MAJOR(dev) != 2 && b[j] == b[j-1]+1 &&
+		       ((long) (buf+j*BLOCK_SIZE) & 0xfff))
+			j++;
+		memset(bh+n,0,sizeof (*bh));
+		bh[n].b_dev = dev;
+		bh[n].b_blocknr = b[i];
+		bh[n].b_data = (char *) user_phys(buf+i*BLOCK_SIZE);
+		bh[n].b_dirt = (rw == WRITE);
+		ll_rw_sectors(rw,bh+n,(j-i)*2);
+		n++;
+	}
+	for (i=0 ; i<n ; i++) {
+		wait_on_direct(bh+i);
+		if (!bh[i].b_uptodate)
+			err = -EIO;
+	}
+	if (rw == WRITE)
+		for (i=0 ; i<nr ; i++)
+			if ((tmp = get_hash_table(dev,b[i]))) {
+				tmp->b_uptodate = 0;
+				brelse(tmp);
+			}
+	return err;
+}
+
+int block_direct(int rw, int dev, off_t * pos, char * buf, int count)
+{
+	int b[NR_MULTI];
+	int i,n,err,done = 0;
+
+	if (IS_TMP(dev))
+		return -ENXIO;
+	if (IS_CFS(dev) && rw == WRITE)
+		return -EROFS;
+	if (!ALIGNED(*pos,buf,count))
+		return (rw == READ) ? block_read(dev,pos,buf,count) :
+			block_write(dev,pos,buf,count);
+	while (done < count) {
+		n = (count-done) / BLOCK_SIZE;
+		if (n > NR_MULTI)
+			n = NR_MULTI;
+		for (i=0 ; i<n ; i++)
+			b[i] = (*pos+done) / BLOCK_SIZE + i;
+		if ((err = direct_io(rw,dev,b,n,buf+done)))
+			return done ? done : err;
+		done += n*BLOCK_SIZE;
+		*pos += n*BLOCK_SIZE;
+	}
+	return done;
+}
+
+/*
+ * A direct read at the end of the file transfers the whole last block:
+ * the user asked for a multiple of BLOCK_SIZE bytes, so there is room.
+ */
+int file_direct(int rw, struct m_inode * inode, struct file * filp,
+	char * buf, int count)
+{
+	int b[NR_MULTI];
+	off_t pos;
+	int i,n,err = 0,done = 0;
+
+	if (rw == WRITE && (filp->f_flags & O_APPEND))
+		pos = inode->i_size;
+	else
+		pos = filp->f_pos;
+	if (IS_TMP(inode->i_dev) || IS_CFS(inode->i_dev) ||
+	    !ALIGNED(pos,buf,count)) {
+		if (rw == WRITE)
+			return file_write(inode,filp,buf,count);
+		if (count+filp->f_pos > inode->i_size)
+			count = inode->i_size - filp->f_pos;
+		if (count<=0)
+			return 0;
+		return file_read(inode,filp,buf,count);
+	}
+	if (rw == READ) {
+		if (count+pos > inode->i_size)
+			count = inode->i_size - pos;
+		if (count<=0)
+			return 0;
+	}
+	flush_dalloc(inode);
+	if (rw == WRITE && pos > inode->i_size)
+		file_zero(inode,inode->i_size,pos);
+	while (done < count) {
+		n = (count-done+BLOCK_SIZE-1) / BLOCK_SIZE;
+		if (n > NR_MULTI)
+			n = NR_MULTI;
+		for (i=0 ; i<n ; i++)
+			if (rw == READ) {
+				if (!(b[i] = bmap(inode,(pos+done)/BLOCK_SIZE+i)))
+					b[i] = -1;
+			} else if (!(b[i] = create_block(inode,
+			    (pos+done)/BLOCK_SIZE+i)))
+				break;
+		if (!i || (err = direct_io(rw,inode->i_dev,b,i,buf+done)))
+			break;
+		done += i*BLOCK_SIZE;
+		if (i < n)
+			break;
+	}
+	if (done > count)
+		done = count;
+	if (rw == READ)
+		inode->i_atime = CURRENT_TIME;
+	else if (done) {
+		if (pos+done > inode->i_size) {
+			inode->i_size = pos+done;
+			inode->i_ddirt = 1;
+		}
+		inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+		inode->i_dirt = 1;
+	}
+	if (rw == READ || !(filp->f_flags & O_APPEND))
+		filp->f_pos = pos+done;
+	if (done)
+		return done;
+	return err ? err : ((rw == WRITE) ? -ENOSPC : 0);
+}
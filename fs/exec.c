@@ -105,7 +105,7 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 		unsigned long p, int from_kmem)
 {
 	char *tmp, *pag=NULL;
-	int len, offset = 0;
+	int len, n, offset = 0;
 	unsigned long old_fs, new_fs;
 
 	if (!p)
@@ -129,21 +129,23 @@ static unsigned long copy_strings(int argc,char ** argv,unsigned long *page,
 			set_fs(old_fs);
 			return 0;
 		}
+/* offset is the room left in pag, below p */
 		while (len) {
-			--p; --tmp; --len;
-			if (--offset < 0) {
-				offset = p % PAGE_SIZE;
+			if (offset <= 0) {
+				offset = (p-1) % PAGE_SIZE + 1;
 				if (from_kmem==2)
 					set_fs(old_fs);
-				if (!(pag = (char *) page[p/PAGE_SIZE]) &&
-				    !(pag = (char *) page[p/PAGE_SIZE] =
+				if (!(pag = (char *) page[(p-1)/PAGE_SIZE]) &&
+				    !(pag = (char *) page[(p-1)/PAGE_SIZE] =
 				      (unsigned long *) get_free_page())) 
 					return 0;
 				if (from_kmem==2)
 					set_fs(new_fs);
 
 			}
-			*(pag + offset) = get_fs_byte(tmp);
+			n = (len < offset) ? len : offset;
+			p -= n; tmp -= n; len -= n; offset -= n;
+			memcpy_fromfs(pag + offset,tmp,n);
 		}
 	}
 	if (from_kmem==2)
@@ -218,7 +220,11 @@ restart_interp:
 		retval = -ENOEXEC;
 		goto exec_error2;
 	}
-	if (!(bh = bread(inode->i_dev,inode->i_zone[0]))) {
+	flush_dalloc(inode);		/* the image is read by block number */
+	i = read_start(inode);
+	bh = bread(inode->i_dev,bmap(inode,0));
+	read_end(inode,i);
+	if (!bh) {
 		retval = -EACCES;
 		goto exec_error2;
 	}
@@ -321,10 +327,9 @@ restart_interp:
 	current->executable = inode;
 	for (i=0 ; i<32 ; i++)
 		current->sigaction[i].sa_handler = NULL;
-	for (i=0 ; i<NR_OPEN ; i++)
-		if ((current->close_on_exec>>i)&1)
+	for (i=0 ; i<current->max_fds ; i++)
+		if (FD_ISSET(i,current->close_on_exec))
 			sys_close(i);
-	current->close_on_exec = 0;
 	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
 	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
 	if (last_task_used_math == current)
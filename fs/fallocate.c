@@ -0,0 +1,131 @@
+/*
+ *  linux/fs/fallocate.c
+ */
+
+/*
+ * fallocate() maps all the holes of a range of a file at once, each run
+ * of them to a run of free zones taken from the zone-map in one go, so
+ * that the file is contiguous and later writes find their blocks ready.
+ *
+ * There's no room in a minix inode to mark blocks as unwritten, so only
+ * blocks past the end of file are left as they are on the disk: readers
+ * never get there, and file_write() clears such a block in the cache the
+ * first time it writes into it. Zones that fill holes inside the file
+ * are cleared through the cache at once, as a read would return them.
+ * With FALLOC_FL_KEEP_SIZE nothing else is done. Without it the file
+ * grows to cover the range, and the new blocks inside it are cleared
+ * too, as writes would do.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+extern void file_zero(struct m_inode * inode, off_t from, off_t to);
+
+/* clear new zone 'zone', mapped as zone nr of the file, if it's inside */
+static void clear_zone(struct m_inode * inode, int nr, int zone, int shift)
+{
+	struct buffer_head * bh;
+	int i;
+
+	if (nr<<shift >= (inode->i_size+BLOCK_SIZE-1)/BLOCK_SIZE)
+		return;
+	for (i=0 ; i < 1<<shift ; i++)
+		if ((bh = getblk(inode->i_dev,(zone<<shift)+i))) {
+			memset(bh->b_data,0,BLOCK_SIZE);
+			bh->b_uptodate = 1;
+			bh->b_dirt = 1;
+			brelse(bh);
+		}
+}
+
+/* map the holes among zones [first,last] of the file, 0 or -ENOSPC */
+static int reserve(struct m_inode * inode, int first, int last, int shift)
+{
+	int z,n,i,j,k,c,zone,goal;
+
+	for (z=first ; z<=last ; z += n) {
+		n = 1;
+		if (bmap(inode,z<<shift))
+			continue;
+		if (IS_TMP(inode->i_dev)) {
+			if (!create_block(inode,z<<shift))
+				return -ENOSPC;
+			continue;
+		}
+		while (z+n <= last && !bmap(inode,(z+n)<<shift))
+			n++;
+		if ((goal = z ? bmap(inode,(z<<shift)-1) : 0))
+			goal = (goal>>shift)+1;
+		else
+			goal = zone_goal(inode);
+		for (i=0 ; i<n ; i += j) {
+			j = n-i;
+			if (!(zone = new_block_run(inode->i_dev,goal,&j)))
+				return -ENOSPC;
+			for (k=0 ; k<j ; k++)
+				if (map_block(inode,(z+i+k)<<shift,zone+k) !=
+				    (zone+k)<<shift)
+					break;
+			for (c=0 ; c<k ; c++)
+				clear_zone(inode,z+i+c,zone+c,shift);
+			if (k < j) {
+				while (k < j)
+					free_block(inode->i_dev,zone+k++);
+				return -ENOSPC;
+			}
+			goal = zone+j;
+		}
+	}
+	return 0;
+}
+
+int sys_fallocate(unsigned int fd, int mode, off_t * range)
+{
+	struct file * file;
+	struct m_inode * inode;
+	struct super_block * sb;
+	off_t offset,len,end;
+	int shift,err;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]) ||
+	    !(inode=file->f_inode))
+		return -EBADF;
+	if ((file->f_flags & O_ACCMODE) == O_RDONLY)
+		return -EBADF;
+	if (!S_ISREG(inode->i_mode))
+		return -ENODEV;
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+		return -EINVAL;
+	offset = get_fs_long((unsigned long *) range);
+	len = get_fs_long((unsigned long *) (range+1));
+	if (offset < 0 || len <= 0)
+		return -EINVAL;
+	if (!(sb = get_super(inode->i_dev)))
+		return -ENODEV;
+	end = offset+len;
+	if (end < offset || end > sb->s_max_size)
+		return -EFBIG;
+	shift = sb->s_log_zone_size + BLOCK_SIZE_BITS;
+	flush_dalloc(inode);
+	err = reserve(inode,offset>>shift,(end-1)>>shift,
+		sb->s_log_zone_size);
+	inode->i_ctime = CURRENT_TIME;
+	inode->i_dirt = 1;
+	if (err)
+		return err;
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && end > inode->i_size) {
+		file_zero(inode,inode->i_size,
+			(end+BLOCK_SIZE-1) & ~(BLOCK_SIZE-1));
+		inode->i_size = end;
+		inode->i_mtime = CURRENT_TIME;
+		inode->i_ddirt = 1;
+	}
+	return 0;
+}
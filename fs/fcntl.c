@@ -17,20 +17,14 @@ extern int sys_close(int fd);
 
 static int dupfd(unsigned int fd, unsigned int arg)
 {
-	if (fd >= NR_OPEN || !current->filp[fd])
+	int newfd;
+
+	if (fd >= current->max_fds || !current->filp[fd])
 		return -EBADF;
-	if (arg >= NR_OPEN)
-		return -EINVAL;
-	while (arg < NR_OPEN)
-		if (current->filp[arg])
-			arg++;
-		else
-			break;
-	if (arg >= NR_OPEN)
-		return -EMFILE;
-	current->close_on_exec &= ~(1<<arg);
-	(current->filp[arg] = current->filp[fd])->f_count++;
-	return arg;
+	if ((newfd = get_unused_fd(arg)) < 0)
+		return newfd;
+	(current->filp[newfd] = current->filp[fd])->f_count++;
+	return newfd;
 }
 
 int sys_dup2(unsigned int oldfd, unsigned int newfd)
@@ -48,25 +42,33 @@ int sys_fcntl(unsigned int fd, unsigned int cmd, unsigned long arg)
 {	
 	struct file * filp;
 
-	if (fd >= NR_OPEN || !(filp = current->filp[fd]))
+	if (fd >= current->max_fds || !(filp = current->filp[fd]))
 		return -EBADF;
 	switch (cmd) {
 		case F_DUPFD:
 			return dupfd(fd,arg);
 		case F_GETFD:
-			return (current->close_on_exec>>fd)&1;
+			return FD_ISSET(fd,current->close_on_exec);
 		case F_SETFD:
 			if (arg&1)
-				current->close_on_exec |= (1<<fd);
+				FD_SET(fd,current->close_on_exec);
 			else
-				current->close_on_exec &= ~(1<<fd);
+				FD_CLR(fd,current->close_on_exec);
 			return 0;
 		case F_GETFL:
 			return filp->f_flags;
 		case F_SETFL:
-			filp->f_flags &= ~(O_APPEND | O_NONBLOCK);
-			filp->f_flags |= arg & (O_APPEND | O_NONBLOCK);
+			filp->f_flags &= ~(O_APPEND | O_NONBLOCK | O_DIRECT);
+			filp->f_flags |= arg & (O_APPEND | O_NONBLOCK | O_DIRECT);
 			return 0;
+		case F_GETPIPE_SZ:
+			if (!filp->f_inode || !filp->f_inode->i_pipe)
+				return -EINVAL;
+			return PIPE_BUF_SIZE(*filp->f_inode);
+		case F_SETPIPE_SZ:
+			if (!filp->f_inode || !filp->f_inode->i_pipe)
+				return -EINVAL;
+			return pipe_resize(filp->f_inode,arg);
 		case F_GETLK:	case F_SETLK:	case F_SETLKW:
 			return -1;
 		default:
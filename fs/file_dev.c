@@ -6,6 +6,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -14,42 +15,118 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/*
+ * file_read() maps up to NR_MULTI blocks of the request at a time and
+ * hands them to bread_multi(), so that the whole batch is queued on the
+ * drive before we start copying out of the first one.
+ */
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
-	int left,chars,nr;
-	struct buffer_head * bh;
+	int left,chars,nr,i,n;
+	int block[NR_MULTI];
+	struct buffer_head * bh[NR_MULTI];
 
 	if ((left=count)<=0)
 		return 0;
 	while (left) {
-		if ((nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE))) {
-			if (!(bh=bread(inode->i_dev,nr)))
+		nr = filp->f_pos / BLOCK_SIZE;
+		n = (filp->f_pos % BLOCK_SIZE + left + BLOCK_SIZE-1) / BLOCK_SIZE;
+		if (n > NR_MULTI)
+			n = NR_MULTI;
+		for (i=0 ; i<n ; i++)
+			block[i] = bmap(inode,nr+i);
+		bread_multi(inode->i_dev,block,n,bh);
+		if (inode->i_dalloc)
+			for (i=0 ; i<n ; i++)
+				if (!block[i])
+					bh[i] = get_dalloc(inode,nr+i);
+		for (i=0 ; i<n ; i++) {
+			if (block[i] && !bh[i])
 				break;
-		} else
-			bh = NULL;
-		nr = filp->f_pos % BLOCK_SIZE;
-		chars = MIN( BLOCK_SIZE-nr , left );
-		filp->f_pos += chars;
-		left -= chars;
-		if (bh) {
-			char * p = nr + bh->b_data;
-			while (chars-->0)
-				put_fs_byte(*(p++),buf++);
-			brelse(bh);
-		} else {
-			while (chars-->0)
-				put_fs_byte(0,buf++);
+			nr = filp->f_pos % BLOCK_SIZE;
+			chars = MIN( BLOCK_SIZE-nr , left );
+			filp->f_pos += chars;
+			left -= chars;
+			if (bh[i]) {
+				memcpy_tofs(buf,nr + bh[i]->b_data,chars);
+				brelse(bh[i]);
+			} else
+				clear_fs(buf,chars);
+			buf += chars;
+		}
+		if (i < n) {
+			while (++i < n)
+				brelse(bh[i]);
+			break;
 		}
 	}
 	inode->i_atime = CURRENT_TIME;
 	return (count-left)?(count-left):-ERROR;
 }
 
+#define NR_READAHEAD (4*NR_MULTI)
+
+/*
+ * file_readahead() starts the reads of the uncached blocks in [pos,
+ * pos+count) of a file without waiting for them (see readv()).
+ */
+void file_readahead(struct m_inode * inode, off_t pos, int count)
+{
+	struct buffer_head * bh;
+	int nr,last,block;
+
+	if (pos >= inode->i_size || count <= 0)
+		return;
+	if (count > inode->i_size - pos)
+		count = inode->i_size - pos;
+	nr = pos / BLOCK_SIZE;
+	last = (pos+count-1) / BLOCK_SIZE;
+	if (last >= nr+NR_READAHEAD)
+		last = nr+NR_READAHEAD-1;
+	for ( ; nr <= last ; nr++)
+		if ((block = bmap(inode,nr)) &&
+		    (bh = getblk(inode->i_dev,block))) {
+			if (!bh->b_uptodate)
+				ll_rw_block(READA,bh);
+			bh->b_count--;
+		}
+}
+
+/*
+ * file_zero() clears the blocks that lie wholly in [from,to), past the
+ * end of file, and are mapped: they were preallocated by fallocate(), and
+ * still hold whatever was on the disk.
+ */
+void file_zero(struct m_inode * inode, off_t from, off_t to)
+{
+	struct buffer_head * bh;
+	int nr,block;
+
+	for (nr = (from+BLOCK_SIZE-1)/BLOCK_SIZE ; nr < to/BLOCK_SIZE ; nr++)
+		if ((block = bmap(inode,nr)) &&
+		    (bh = getblk(inode->i_dev,block))) {
+			memset(bh->b_data,0,BLOCK_SIZE);
+			bh->b_uptodate = 1;
+			bh->b_dirt = 1;
+			brelse(bh);
+		}
+}
+
+/*
+ * Only the partial blocks at the ends of a write that lie inside the
+ * file have to be read before they are written: whole blocks and blocks
+ * past the end of file are just taken with getblk(). The (at most two)
+ * partial blocks are read together before we start copying.
+ *
+ * Holes and blocks past the end get delalloc buffers: their disk blocks
+ * are allocated later, all at once, by flush_dalloc().
+ */
 int file_write(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
 	off_t pos;
-	int block,c;
-	struct buffer_head * bh;
+	int block,c,n;
+	int b[2];
+	struct buffer_head * bh, * pbh[2];
 	char * p;
 	int i=0;
 
@@ -61,12 +138,33 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 		pos = inode->i_size;
 	else
 		pos = filp->f_pos;
+	if (pos > inode->i_size)
+		file_zero(inode,inode->i_size,pos);
+	n = 0;
+	if ((pos % BLOCK_SIZE) && pos - pos % BLOCK_SIZE < inode->i_size)
+		b[n++] = bmap(inode,pos/BLOCK_SIZE);
+	c = pos + count;
+	if ((c % BLOCK_SIZE) && c - c % BLOCK_SIZE < inode->i_size &&
+	    (!n || c/BLOCK_SIZE != pos/BLOCK_SIZE))
+		b[n++] = bmap(inode,c/BLOCK_SIZE);
+	bread_multi(inode->i_dev,b,n,pbh);
+	while (n--)
+		brelse(pbh[n]);
 	while (i<count) {
-		if (!(block = create_block(inode,pos/BLOCK_SIZE)))
+		c = pos % BLOCK_SIZE;
+		if (!(block = bmap(inode,pos/BLOCK_SIZE)) &&
+		    (bh = getblk_dalloc(inode,pos/BLOCK_SIZE)))
+			/* no disk block until the file is flushed */ ;
+		else if (!block && !(block = create_block(inode,pos/BLOCK_SIZE)))
 			break;
-		if (!(bh=bread(inode->i_dev,block)))
+		else if ((!c && count-i >= BLOCK_SIZE) || pos-c >= inode->i_size) {
+			bh = getblk(inode->i_dev,block);
+			if (!bh->b_uptodate) {
+				memset(bh->b_data,0,BLOCK_SIZE);
+				bh->b_uptodate = 1;
+			}
+		} else if (!(bh=bread(inode->i_dev,block)))
 			break;
-		c = pos % BLOCK_SIZE;
 		p = c + bh->b_data;
 		bh->b_dirt = 1;
 		c = BLOCK_SIZE-c;
@@ -74,11 +172,11 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 		pos += c;
 		if (pos > inode->i_size) {
 			inode->i_size = pos;
-			inode->i_dirt = 1;
+			inode->i_dirt = inode->i_ddirt = 1;
 		}
 		i += c;
-		while (c-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,c);
+		buf += c;
 		brelse(bh);
 	}
 	inode->i_mtime = CURRENT_TIME;
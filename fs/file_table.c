@@ -4,6 +4,193 @@
  *  (C) 1991  Linus Torvalds
  */
 
-#include <linux/fs.h>
+/*
+ * The file structures are carved out of pages as they are needed, up to
+ * NR_FILE of them, and unused ones are kept on a free list, so that
+ * getting one doesn't mean searching a table. The pages are never given
+ * back.
+ *
+ * Each task has its own fd table (see sched.h): get_unused_fd() finds
+ * the lowest free fd in the bitmap, starting at next_fd, below which all
+ * fds are known to be in use, and grows the table when it is full.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+static struct file * free_files = NULL;
+static int nr_files = 0;
+
+/*
+ * Returns a file with f_count 1, or NULL if there are NR_FILE already.
+ */
+struct file * get_empty_filp(void)
+{
+	struct file * f;
+	int i;
+
+	if (!free_files) {
+		if (nr_files + FILES_PER_PAGE > NR_FILE ||
+		    !(f = (struct file *) get_free_page()))
+			return NULL;
+		for (i=0 ; i<FILES_PER_PAGE ; i++,f++) {
+			f->f_next = free_files;
+			free_files = f;
+		}
+		nr_files += FILES_PER_PAGE;
+	}
+	f = free_files;
+	free_files = f->f_next;
+	f->f_next = NULL;
+	f->f_count = 1;
+	return f;
+}
+
+void put_filp(struct file * f)
+{
+	f->f_count = 0;
+	f->f_inode = NULL;
+	f->f_next = free_files;
+	free_files = f;
+}
+
+/*
+ * Lowest clear bit in map from start on, or end if there is none.
+ * end is a multiple of 32.
+ */
+static unsigned long find_zero(unsigned long * map, unsigned long start,
+	unsigned long end)
+{
+	unsigned long i, w, bit;
+
+	for (i=start>>5 ; i < end>>5 ; i++) {
+		w = ~map[i];
+		if (i == start>>5)
+			w &= ~0UL << (start&31);
+		if (w) {
+			__asm__("bsfl %1,%0":"=r" (bit):"r" (w));
+			return (i<<5)+bit;
+		}
+	}
+	return end;
+}
+
+static void set_fd_table(struct task_struct * p, struct file ** filp,
+	unsigned long pages)
+{
+	p->fd_pages = pages;
+	p->filp = filp;
+	if (!pages) {
+		p->max_fds = NR_OPEN_DEF;
+		p->open_fds = p->fd_bits;
+		p->close_on_exec = p->fd_bits+1;
+		return;
+	}
+	p->max_fds = FDS_IN_PAGES(pages);
+	p->open_fds = (unsigned long *) (filp + p->max_fds);
+	p->close_on_exec = p->open_fds + p->max_fds/32;
+}
 
-struct file file_table[NR_FILE];
+/*
+ * Make the table of the current task big enough to hold fd. The new
+ * table is the smallest that will do, in 1, 2 or 4 pages.
+ */
+static int expand_fds(unsigned long fd)
+{
+	struct file ** filp, ** old_filp;
+	unsigned long * open_fds, * close_on_exec;
+	unsigned long pages, old_pages, max;
+
+	for (pages=1 ; FDS_IN_PAGES(pages) <= fd ; pages <<= 1)
+		/* nothing */ ;
+	if (!(filp = (struct file **) get_free_pages(pages)))
+		return -ENOMEM;
+	max = current->max_fds;
+	old_filp = current->filp;
+	old_pages = current->fd_pages;
+	open_fds = current->open_fds;
+	close_on_exec = current->close_on_exec;
+	set_fd_table(current,filp,pages);
+	memcpy(filp,old_filp,max*sizeof (struct file *));
+	memcpy(current->open_fds,open_fds,max/8);
+	memcpy(current->close_on_exec,close_on_exec,max/8);
+	if (old_pages)
+		free_pages((unsigned long) old_filp,old_pages);
+	return 0;
+}
+
+/*
+ * Reserve the lowest free fd not below start, clearing its close-on-exec
+ * flag. The caller fills in filp[fd], or gives it back with
+ * put_unused_fd().
+ */
+int get_unused_fd(unsigned int start)
+{
+	unsigned long fd;
+	int lowest = 0, error;
+
+	if (start >= NR_OPEN)
+		return -EINVAL;
+	if (start <= current->next_fd) {
+		start = current->next_fd;
+		lowest = 1;
+	}
+	fd = start;
+	if (fd < current->max_fds)
+		fd = find_zero(current->open_fds,fd,current->max_fds);
+	if (fd >= NR_OPEN)
+		return -EMFILE;
+	if (fd >= current->max_fds && (error = expand_fds(fd)))
+		return error;
+	FD_SET(fd,current->open_fds);
+	FD_CLR(fd,current->close_on_exec);
+	if (lowest)
+		current->next_fd = fd+1;
+	return fd;
+}
+
+void put_unused_fd(unsigned int fd)
+{
+	FD_CLR(fd,current->open_fds);
+	FD_CLR(fd,current->close_on_exec);
+	if (fd < current->next_fd)
+		current->next_fd = fd;
+}
+
+/*
+ * fork(): p is a copy of the current task, so its table pointers still
+ * point at ours. Give it its own copy of the table. The file counts are
+ * left to the caller.
+ */
+int copy_fds(struct task_struct * p)
+{
+	struct file ** filp;
+
+	if (!p->fd_pages) {
+		set_fd_table(p,p->fd_array,0);
+		return 0;
+	}
+	if (!(filp = (struct file **) get_free_pages(p->fd_pages)))
+		return -ENOMEM;
+	memcpy(filp,current->filp,p->fd_pages*PAGE_SIZE);
+	set_fd_table(p,filp,p->fd_pages);
+	return 0;
+}
+
+/*
+ * Give back the table of p, whose fds must all be closed already (or
+ * never counted, after a failed fork).
+ */
+void free_fds(struct task_struct * p)
+{
+	if (p->fd_pages)
+		free_pages((unsigned long) p->filp,p->fd_pages);
+	memset(p->fd_array,0,sizeof (p->fd_array));
+	p->fd_bits[0] = p->fd_bits[1] = 0;
+	p->next_fd = 0;
+	set_fd_table(p,p->fd_array,0);
+}
@@ -0,0 +1,126 @@
+/*
+ *  linux/fs/fsync.c
+ */
+
+/*
+ * fsync(), fdatasync() and sync_file_range() write out the dirty buffers
+ * of one file only, found through its block map, and then wait for just
+ * those writes instead of flushing the whole machine like sync() does.
+ */
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#define SYNC_RANGE	0	/* the data blocks only */
+#define SYNC_DATA	1	/* and what is needed to find them */
+#define SYNC_ALL	2	/* and the inode itself */
+
+/*
+ * Start the write of a cached dirty block, or wait for it if 'wait'.
+ * Returns 1 if the write failed: the buffer is then no longer uptodate.
+ */
+static int sync_block(int dev, int block, int wait)
+{
+	struct buffer_head * bh;
+	int bad;
+
+	if (!block || !(bh = get_hash_table(dev,block)))
+		return 0;
+	if (!wait && bh->b_dirt)
+		ll_rw_block(WRITE,bh);
+	bad = wait && !bh->b_uptodate;
+	brelse(bh);
+	return bad;
+}
+
+static int sync_ind(struct m_inode * inode, struct super_block * sb, int wait)
+{
+	struct buffer_head * bh;
+	int i,bad,shift = sb->s_log_zone_size;
+
+	bad = sync_block(inode->i_dev,inode->i_zone[7]<<shift,wait);
+	if (!inode->i_zone[8])
+		return bad;
+	if ((bh = bread(inode->i_dev,inode->i_zone[8]<<shift))) {
+		for (i=0 ; i<IND_ZONES(sb) ; i++)
+			bad |= sync_block(inode->i_dev,
+				ind_zone(sb,bh->b_data,i)<<shift,wait);
+		brelse(bh);
+	} else
+		bad = 1;
+	bad |= sync_block(inode->i_dev,inode->i_zone[8]<<shift,wait);
+	return bad;
+}
+
+static int file_sync(unsigned int fd, off_t start, off_t nbytes, int how)
+{
+	struct file * file;
+	struct m_inode * inode;
+	struct super_block * sb;
+	int first,last,nr,wait,i;
+	int block = 0, bad = 0;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]) ||
+	    !(inode=file->f_inode))
+		return -EBADF;
+	if (S_ISBLK(inode->i_mode)) {
+		sync_dev(inode->i_zone[0]);
+		return 0;
+	}
+	if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode))
+		return -EINVAL;
+	if (start < 0 || nbytes < 0)
+		return -EINVAL;
+	if (IS_TMP(inode->i_dev))
+		return 0;		/* nothing to write, ever */
+	if (!(sb = get_super(inode->i_dev)))
+		return -ENODEV;
+	flush_dalloc(inode);
+	first = start / BLOCK_SIZE;
+	last = (inode->i_size + BLOCK_SIZE-1) / BLOCK_SIZE;
+	if (nbytes && (start+nbytes+BLOCK_SIZE-1) / BLOCK_SIZE < last)
+		last = (start+nbytes+BLOCK_SIZE-1) / BLOCK_SIZE;
+	if (how == SYNC_ALL || (how == SYNC_DATA && inode->i_ddirt))
+		block = sync_inode(inode);
+	else if (how == SYNC_DATA)
+		/* i_ddirt is cleared once the inode is copied, not written */
+		block = inode_block(sb,inode->i_num);
+	for (wait=0 ; wait<2 ; wait++) {
+		for (nr=first ; nr<last ; nr++)
+			bad |= sync_block(inode->i_dev,bmap(inode,nr),wait);
+		if (how == SYNC_RANGE)
+			continue;
+		bad |= sync_ind(inode,sb,wait);
+		for (i=0 ; i < sb->s_imap_blocks+sb->s_zmap_blocks ; i++)
+			bad |= sync_block(inode->i_dev,2+i,wait);
+		if (IS_GRP(sb)) {	/* the maps of the group of the inode */
+			i = (inode->i_num-1) / sb->s_ipg;
+			bad |= sync_block(inode->i_dev,
+				group_desc(sb,i)->g_zmap,wait);
+			bad |= sync_block(inode->i_dev,
+				group_desc(sb,i)->g_imap,wait);
+		}
+		bad |= sync_block(inode->i_dev,block,wait);
+	}
+	return bad ? -EIO : 0;
+}
+
+int sys_fsync(unsigned int fd)
+{
+	return file_sync(fd,0,0,SYNC_ALL);
+}
+
+/* like fsync, but the inode is only written if its size or zones changed */
+int sys_fdatasync(unsigned int fd)
+{
+	return file_sync(fd,0,0,SYNC_DATA);
+}
+
+/* the data blocks in [offset,offset+nbytes), or to EOF if nbytes is 0 */
+int sys_sync_file_range(unsigned int fd, off_t offset, off_t nbytes)
+{
+	return file_sync(fd,offset,nbytes,SYNC_RANGE);
+}
@@ -0,0 +1,74 @@
+/*
+ *  linux/fs/group.c
+ */
+
+/*
+ * group.c has the super-block and inode table code of the group
+ * filesystem (see linux/fs.h). Its maps are handled in bitmap.c, next to
+ * the minix ones, and everything else is shared with minix: only the
+ * layout of the inodes and the width of the zone numbers differ.
+ *
+ * The group descriptors stay in memory while the filesystem is mounted,
+ * in the s_zmap[] slots minix uses for its zone-map, and keep the free
+ * counts of each group. The maps themselves are read as they're needed.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+/* 'bh' is block 1 of the device, which holds a group super-block */
+int grp_read_super(struct super_block * sb, struct buffer_head * bh)
+{
+	struct d_grp_super_block * d = (struct d_grp_super_block *) bh->b_data;
+	struct grp_desc * g;
+	int i,n;
+
+	sb->s_ninodes = d->s_ninodes;
+	sb->s_ngroups = d->s_ngroups;
+	sb->s_nzones = d->s_nzones;
+	sb->s_ipg = d->s_ipg;
+	sb->s_log_zone_size = d->s_log_zone_size;
+	sb->s_max_size = d->s_max_size;
+	sb->s_magic = d->s_magic;
+	n = (sb->s_ngroups + GRP_DESC_PER_BLOCK-1) / GRP_DESC_PER_BLOCK;
+	if (!sb->s_ngroups || n > Z_MAP_SLOTS || !sb->s_ipg ||
+	    sb->s_ipg > GRP_ZONES || sb->s_ipg % GRP_INODES_PER_BLOCK ||
+	    sb->s_ngroups * sb->s_ipg != sb->s_ninodes ||
+	    sb->s_nzones > sb->s_ngroups * GRP_ZONES)
+		return -1;
+	sb->s_imap_blocks = 0;
+	sb->s_zmap_blocks = n;
+	sb->s_firstdatazone = (2+n + (1<<sb->s_log_zone_size)-1) >>
+		sb->s_log_zone_size;
+	for (i=0 ; i<n ; i++)
+		if (!(sb->s_zmap[i] = bread(sb->s_dev,2+i)))
+			return -1;
+	sb->s_free_zones = sb->s_free_inodes = 0;
+	for (i=0 ; i < sb->s_ngroups ; i++) {
+		g = group_desc(sb,i);
+		sb->s_free_zones += g->g_free_zones;
+		sb->s_free_inodes += g->g_free_inodes;
+	}
+	return 0;
+}
+
+int grp_inode_block(struct super_block * sb, int nr)
+{
+	nr--;
+	return group_desc(sb,nr / sb->s_ipg)->g_itable +
+		(nr % sb->s_ipg) / GRP_INODES_PER_BLOCK;
+}
+
+/*
+ * zone_goal() is where new zones for 'inode' are first looked for when
+ * there's nothing better: the start of the group of the inode, on a group
+ * filesystem. Zero means anywhere.
+ */
+int zone_goal(struct m_inode * inode)
+{
+	struct super_block * sb;
+
+	if (!(sb = get_super(inode->i_dev)) || !IS_GRP(sb))
+		return 0;
+	return ((inode->i_num-1) / sb->s_ipg) * GRP_ZONES;
+}
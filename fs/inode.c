@@ -7,6 +7,7 @@
 #include <string.h> 
 #include <sys/stat.h>
 
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
@@ -16,6 +17,11 @@ struct m_inode inode_table[NR_INODE]={{0,},};
 
 static void read_inode(struct m_inode * inode);
 static void write_inode(struct m_inode * inode);
+static void write_inodes(struct m_inode ** list, int n);
+
+/* the place of inode 'nr' in its block */
+#define inode_slot(sb,nr) (IS_GRP(sb) ? \
+	((nr)-1) % (sb)->s_ipg % GRP_INODES_PER_BLOCK : ((nr)-1) % INODES_PER_BLOCK)
 
 static inline void wait_on_inode(struct m_inode * inode)
 {
@@ -40,6 +46,81 @@ static inline void unlock_inode(struct m_inode * inode)
 	wake_up(&inode->i_wait);
 }
 
+/*
+ * The zone numbers are 32 bits in memory: unpack_inode() and pack_inode()
+ * convert from and to a minix (or tmpfs) inode.
+ */
+void unpack_inode(struct m_inode * inode, struct d_inode * d)
+{
+	int i;
+
+	inode->i_mode = d->i_mode;
+	inode->i_uid = d->i_uid;
+	inode->i_size = d->i_size;
+	inode->i_mtime = d->i_time;
+	inode->i_gid = d->i_gid;
+	inode->i_nlinks = d->i_nlinks;
+	for (i=0 ; i<9 ; i++)
+		inode->i_zone[i] = d->i_zone[i];
+}
+
+void pack_inode(struct d_inode * d, struct m_inode * inode)
+{
+	int i;
+
+	d->i_mode = inode->i_mode;
+	d->i_uid = inode->i_uid;
+	d->i_size = inode->i_size;
+	d->i_time = inode->i_mtime;
+	d->i_gid = inode->i_gid;
+	d->i_nlinks = inode->i_nlinks;
+	for (i=0 ; i<9 ; i++)
+		d->i_zone[i] = inode->i_zone[i];
+}
+
+/* copy inode 'nr' from or to the inode block 'data' */
+static void get_d_inode(struct super_block * sb, struct m_inode * inode,
+	char * data, int nr)
+{
+	struct g_inode * g;
+	int i;
+
+	if (!IS_GRP(sb)) {
+		unpack_inode(inode,(struct d_inode *) data + inode_slot(sb,nr));
+		return;
+	}
+	g = (struct g_inode *) data + inode_slot(sb,nr);
+	inode->i_mode = g->i_mode;
+	inode->i_uid = g->i_uid;
+	inode->i_size = g->i_size;
+	inode->i_mtime = g->i_time;
+	inode->i_gid = g->i_gid;
+	inode->i_nlinks = g->i_nlinks;
+	for (i=0 ; i<9 ; i++)
+		inode->i_zone[i] = g->i_zone[i];
+}
+
+static void put_d_inode(struct super_block * sb, char * data, int nr,
+	struct m_inode * inode)
+{
+	struct g_inode * g;
+	int i;
+
+	if (!IS_GRP(sb)) {
+		pack_inode((struct d_inode *) data + inode_slot(sb,nr),inode);
+		return;
+	}
+	g = (struct g_inode *) data + inode_slot(sb,nr);
+	g->i_mode = inode->i_mode;
+	g->i_uid = inode->i_uid;
+	g->i_size = inode->i_size;
+	g->i_time = inode->i_mtime;
+	g->i_gid = inode->i_gid;
+	g->i_nlinks = inode->i_nlinks;
+	for (i=0 ; i<9 ; i++)
+		g->i_zone[i] = inode->i_zone[i];
+}
+
 void invalidate_inodes(int dev)
 {
 	int i;
@@ -51,102 +132,221 @@ void invalidate_inodes(int dev)
 		if (inode->i_dev == dev) {
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
-			inode->i_dev = inode->i_dirt = 0;
+			inode->i_dev = inode->i_dirt = inode->i_ddirt = 0;
 		}
 	}
 }
 
+/*
+ * sync_inodes() makes a list of the dirty inodes, sorted by device and
+ * number so that the ones sharing an inode block end up next to each
+ * other, and writes each such group with a single read-modify-write of
+ * its block. Clean inodes aren't waited on at all.
+ */
 void sync_inodes(void)
 {
-	int i;
-	struct m_inode * inode;
+	struct m_inode * list[NR_INODE], * inode;
+	struct super_block * sb;
+	int i,j,n = 0;
 
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
-		wait_on_inode(inode);
-		if (inode->i_dirt && !inode->i_pipe)
-			write_inode(inode);
+	for (inode = inode_table ; inode < inode_table+NR_INODE ; inode++) {
+		if (!inode->i_dirt || inode->i_pipe || !inode->i_dev)
+			continue;
+		for (i = n++ ; i > 0 && (list[i-1]->i_dev > inode->i_dev ||
+		     (list[i-1]->i_dev == inode->i_dev &&
+		      list[i-1]->i_num > inode->i_num)) ; i--)
+			list[i] = list[i-1];
+		list[i] = inode;
+	}
+	for (i=0 ; i<n ; i=j) {
+		sb = get_super(list[i]->i_dev);
+		for (j=i+1 ; j<n && sb && list[j]->i_dev == list[i]->i_dev &&
+		     inode_block(sb,list[j]->i_num) ==
+		     inode_block(sb,list[i]->i_num) ; j++)
+			/* nothing */ ;
+		write_inodes(list+i,j-i);
 	}
 }
 
-static int _bmap(struct m_inode * inode,int block,int create)
+/* the data zone itself is 'zone' if given (see flush_dalloc) */
+#define new_zone(inode,zone,goal) \
+	((zone)?(zone):new_block((inode)->i_dev,(goal)))
+
+/*
+ * zone_bmap() maps zone 'block' of the file to a zone on the disk. Both
+ * the inode and the indirect blocks hold zone numbers: an indirect block
+ * is the first block of its zone.
+ */
+static int zone_bmap(struct m_inode * inode,int block,int create,int zone,
+	struct super_block * sb)
 {
 	struct buffer_head * bh;
-	int i;
+	int i,shift,bits,goal;
 
 	if (block<0)
 		panic("_bmap: block<0");
-	if (block >= 7+512+512*512)
+	if (block >= MAX_ZONES(sb))
 		panic("_bmap: block>big");
+	shift = sb->s_log_zone_size;
+	bits = IND_BITS(sb);
+	goal = create ? zone_goal(inode) : 0;
 	if (block<7) {
 		if (create && !inode->i_zone[block])
-			if ((inode->i_zone[block]=new_block(inode->i_dev))) {
+			if ((inode->i_zone[block]=new_zone(inode,zone,goal))) {
 				inode->i_ctime=CURRENT_TIME;
-				inode->i_dirt=1;
+				inode->i_dirt=inode->i_ddirt=1;
 			}
 		return inode->i_zone[block];
 	}
 	block -= 7;
-	if (block<512) {
+	if (block < (1<<bits)) {
 		if (create && !inode->i_zone[7])
-			if ((inode->i_zone[7]=new_block(inode->i_dev))) {
-				inode->i_dirt=1;
+			if ((inode->i_zone[7]=new_block(inode->i_dev,goal))) {
+				inode->i_dirt=inode->i_ddirt=1;
 				inode->i_ctime=CURRENT_TIME;
 			}
 		if (!inode->i_zone[7])
 			return 0;
-		if (!(bh = bread(inode->i_dev,inode->i_zone[7])))
+		if (!(bh = bread(inode->i_dev,inode->i_zone[7]<<shift)))
 			return 0;
-		i = ((unsigned short *) (bh->b_data))[block];
+		i = ind_zone(sb,bh->b_data,block);
 		if (create && !i)
-			if ((i=new_block(inode->i_dev))) {
-				((unsigned short *) (bh->b_data))[block]=i;
+			if ((i=new_zone(inode,zone,goal))) {
+				set_ind_zone(sb,bh->b_data,block,i);
 				bh->b_dirt=1;
 			}
 		brelse(bh);
 		return i;
 	}
-	block -= 512;
+	block -= 1<<bits;
 	if (create && !inode->i_zone[8])
-		if ((inode->i_zone[8]=new_block(inode->i_dev))) {
-			inode->i_dirt=1;
+		if ((inode->i_zone[8]=new_block(inode->i_dev,goal))) {
+			inode->i_dirt=inode->i_ddirt=1;
 			inode->i_ctime=CURRENT_TIME;
 		}
 	if (!inode->i_zone[8])
 		return 0;
-	if (!(bh=bread(inode->i_dev,inode->i_zone[8])))
+	if (!(bh=bread(inode->i_dev,inode->i_zone[8]<<shift)))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block>>9];
+	i = ind_zone(sb,bh->b_data,block>>bits);
 	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block>>9]=i;
+		if ((i=new_block(inode->i_dev,goal))) {
+			set_ind_zone(sb,bh->b_data,block>>bits,i);
 			bh->b_dirt=1;
 		}
 	brelse(bh);
 	if (!i)
 		return 0;
-	if (!(bh=bread(inode->i_dev,i)))
+	if (!(bh=bread(inode->i_dev,i<<shift)))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block&511];
+	block &= (1<<bits)-1;
+	i = ind_zone(sb,bh->b_data,block);
 	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block&511]=i;
+		if ((i=new_zone(inode,zone,goal))) {
+			set_ind_zone(sb,bh->b_data,block,i);
 			bh->b_dirt=1;
 		}
 	brelse(bh);
 	return i;
 }
 
+/*
+ * _bmap() maps block 'block' of the file to a block on the disk. A zone
+ * is 1<<s_log_zone_size blocks, and is always allocated as a whole.
+ */
+static int _bmap(struct m_inode * inode,int block,int create,int zone)
+{
+	struct super_block * sb;
+	int shift;
+
+	if (!(sb = get_super(inode->i_dev)))
+		panic("_bmap: trying to map block on nonexistent device");
+	shift = sb->s_log_zone_size;
+	if (!(zone = zone_bmap(inode,block>>shift,create,zone,sb)))
+		return 0;
+	return (zone<<shift) + (block & ((1<<shift)-1));
+}
+
 int bmap(struct m_inode * inode,int block)
 {
-	return _bmap(inode,block,0);
+	return _bmap(inode,block,0,0);
 }
 
 int create_block(struct m_inode * inode, int block)
 {
-	return _bmap(inode,block,1);
+	return _bmap(inode,block,1,0);
+}
+
+int map_block(struct m_inode * inode, int block, int zone)
+{
+	return _bmap(inode,block,1,zone);
 }
 		
+#define WANTED(zone,data) (!(zone) == !(data))
+
+/* the first of entries [from,to) of indirect zone 'ind' that is WANTED */
+static int find_ind(struct super_block * sb,int ind,int from,int to,int data)
+{
+	struct buffer_head * bh;
+
+	if (!ind)
+		return data ? to : from;
+	if (!(bh = bread(sb->s_dev,ind<<sb->s_log_zone_size)))
+		return from;
+	while (from < to && !WANTED(ind_zone(sb,bh->b_data,from),data))
+		from++;
+	brelse(bh);
+	return from;
+}
+
+/*
+ * find_zone() returns the first zone in [zone,last) of the file that is
+ * mapped if 'data', or a hole if not, or 'last' if there is none. Whole
+ * unmapped indirect zones are skipped without looking any further, so
+ * only the zone maps are ever read (see lseek()).
+ */
+int find_zone(struct m_inode * inode,int zone,int last,int data)
+{
+	struct super_block * sb;
+	struct buffer_head * bh;
+	int n,bits,i,to;
+
+	if (!(sb = get_super(inode->i_dev)))
+		panic("find_zone: no super-block");
+	bits = IND_BITS(sb);
+	n = 1<<bits;
+	if (last > MAX_ZONES(sb))
+		last = MAX_ZONES(sb);
+	for ( ; zone < 7 && zone < last ; zone++)
+		if (WANTED(inode->i_zone[zone],data))
+			return zone;
+	if (zone >= last)
+		return last;
+	if (zone < 7+n) {
+		to = (last < 7+n) ? last : 7+n;
+		if ((zone = 7+find_ind(sb,inode->i_zone[7],
+		    zone-7,to-7,data)) < to)
+			return zone;
+		if (zone >= last)
+			return last;
+	}
+	if (!inode->i_zone[8])
+		return data ? last : zone;
+	if (!(bh = bread(inode->i_dev,inode->i_zone[8]<<sb->s_log_zone_size)))
+		return zone;
+	for (i = (zone-7-n)>>bits ; zone < last ; i++) {
+		to = 7+n+((i+1)<<bits);
+		if (to > last)
+			to = last;
+		if ((zone = 7+n+(i<<bits)+find_ind(sb,
+		    ind_zone(sb,bh->b_data,i),
+		    (zone-7-n)&(n-1),to-7-n-(i<<bits),data)) < to)
+			break;
+	}
+	brelse(bh);
+	return (zone < last) ? zone : last;
+}
+
 void iput(struct m_inode * inode)
 {
 	if (!inode)
@@ -158,12 +358,19 @@ void iput(struct m_inode * inode)
 		wake_up(&inode->i_wait);
 		if (--inode->i_count)
 			return;
-		free_page(inode->i_size);
+		free_pages(inode->i_size,PIPE_BUF_SIZE(*inode)/PAGE_SIZE);
 		inode->i_count=0;
 		inode->i_dirt=0;
 		inode->i_pipe=0;
 		return;
 	}
+	if (inode->i_notify) {
+		if (--inode->i_count)
+			return;
+		notify_release(inode);
+		inode->i_notify=0;
+		return;
+	}
 	if (!inode->i_dev) {
 		inode->i_count--;
 		return;
@@ -172,21 +379,19 @@ void iput(struct m_inode * inode)
 		sync_dev(inode->i_zone[0]);
 		wait_on_inode(inode);
 	}
-repeat:
 	if (inode->i_count>1) {
 		inode->i_count--;
 		return;
 	}
 	if (!inode->i_nlinks) {
+		notify_free(inode);
+		if (defer_truncate(inode))
+			return;		/* truncd drops it when done */
 		truncate(inode);
 		free_inode(inode);
 		return;
 	}
-	if (inode->i_dirt) {
-		write_inode(inode);	/* we can sleep - so do again */
-		wait_on_inode(inode);
-		goto repeat;
-	}
+/* a dirty inode is written by the next sync, or when its slot is reused */
 	inode->i_count--;
 	return;
 }
@@ -204,7 +409,8 @@ struct m_inode * get_empty_inode(void)
 				last_inode = inode_table;
 			if (!last_inode->i_count) {
 				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock)
+				if (!inode->i_dirt && !inode->i_lock &&
+				    !inode->i_dalloc)
 					break;
 			}
 		}
@@ -215,6 +421,9 @@ struct m_inode * get_empty_inode(void)
 			panic("No free inodes in mem");
 		}
 		wait_on_inode(inode);
+		flush_dalloc(inode);
+		if (inode->i_dirt)
+			sync_inodes();	/* the others go in the same blocks */
 		while (inode->i_dirt) {
 			write_inode(inode);
 			wait_on_inode(inode);
@@ -225,18 +434,27 @@ struct m_inode * get_empty_inode(void)
 	return inode;
 }
 
+/*
+ * The buffer is PIPE_DEF_SIZE if there are that many contiguous pages,
+ * or the biggest power of two that fits.
+ */
 struct m_inode * get_pipe_inode(void)
 {
 	struct m_inode * inode;
+	int pages;
 
 	if (!(inode = get_empty_inode()))
 		return NULL;
-	if (!(inode->i_size=get_free_page())) {
+	for (pages = PIPE_DEF_SIZE/PAGE_SIZE ; pages ; pages >>= 1)
+		if ((inode->i_size=get_free_pages(pages)))
+			break;
+	if (!pages) {
 		inode->i_count = 0;
 		return NULL;
 	}
 	inode->i_count = 2;	/* sum of readers/writers */
 	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
+	PIPE_BUF_SIZE(*inode) = pages*PAGE_SIZE;
 	inode->i_pipe = 1;
 	return inode;
 }
@@ -291,48 +509,160 @@ struct m_inode * iget(int dev,int nr)
 	return inode;
 }
 
+#ifdef INODE_FILL
+#define inode_used(sb,nr) \
+((sb)->s_imap[(nr)>>13]->b_data[((nr)&8191)>>3] & (1 << ((nr)&7)))
+
+/*
+ * fill_inodes() copies the other in-use inodes of a freshly read inode
+ * block into unused, clean slots of the inode table. Nothing here sleeps,
+ * so nobody can get at a slot while we fill it.
+ */
+static void fill_inodes(struct super_block * sb, struct buffer_head * bh,
+	int block)
+{
+	struct m_inode * inode, * slot = inode_table;
+	int i,nr;
+
+	nr = (block - inode_block(sb,1)) * INODES_PER_BLOCK + 1;
+	for (i=0 ; i<INODES_PER_BLOCK && nr<=sb->s_ninodes ; i++,nr++) {
+		if (!inode_used(sb,nr))
+			continue;
+		for (inode = inode_table ; inode < inode_table+NR_INODE ; inode++)
+			if (inode->i_dev == sb->s_dev && inode->i_num == nr)
+				break;
+		if (inode < inode_table+NR_INODE)
+			continue;
+		for ( ; slot < inode_table+NR_INODE ; slot++)
+			if (!slot->i_count && !slot->i_dirt && !slot->i_lock &&
+			    !slot->i_dalloc && !slot->i_pipe)
+				break;
+		if (slot >= inode_table+NR_INODE)
+			return;
+		memset(slot,0,sizeof(*slot));
+		unpack_inode(slot,(struct d_inode *)bh->b_data + i);
+		slot->i_dev = sb->s_dev;
+		slot->i_num = nr;
+		slot++;
+	}
+}
+#endif
+
+/*
+ * When the inodes are read in increasing order (a stat of every name in
+ * a directory, mostly) the next two inode blocks are read ahead.
+ */
 static void read_inode(struct m_inode * inode)
 {
+	static int last_dev = 0, last_num = 0;
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	int block,end;
 
 	lock_inode(inode);
 	if (!(sb=get_super(inode->i_dev)))
 		panic("trying to read inode without dev");
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
-	if (!(bh=bread(inode->i_dev,block)))
+	if (IS_TMP(inode->i_dev)) {
+		unpack_inode(inode,sb->s_itable + inode->i_num);
+		unlock_inode(inode);
+		return;
+	}
+	block = inode_block(sb,inode->i_num);
+	if (IS_GRP(sb))		/* the end of the inode table of the group */
+		end = inode_block(sb,
+			((inode->i_num-1)/sb->s_ipg + 1) * sb->s_ipg);
+	else
+		end = inode_block(sb,sb->s_ninodes);
+	if (inode->i_dev == last_dev && inode->i_num > last_num &&
+	    inode->i_num <= last_num + INODES_PER_BLOCK)
+		bh = breada(inode->i_dev,block,
+			(block+1 <= end) ? block+1 : -1,
+			(block+2 <= end) ? block+2 : -1, -1);
+	else
+		bh = bread(inode->i_dev,block);
+	last_dev = inode->i_dev;
+	last_num = inode->i_num;
+	if (!bh)
 		panic("unable to read i-node block");
-	*(struct d_inode *)inode =
-		((struct d_inode *)bh->b_data)
-			[(inode->i_num-1)%INODES_PER_BLOCK];
+	get_d_inode(sb,inode,bh->b_data,inode->i_num);
+#ifdef INODE_FILL
+	if (!IS_GRP(sb))
+		fill_inodes(sb,bh,block);
+#endif
 	brelse(bh);
 	unlock_inode(inode);
 }
 
-static void write_inode(struct m_inode * inode)
+/* tmpfs inodes are just copied back into the inode page */
+static void tmp_write_inode(struct super_block * sb, struct m_inode * inode)
+{
+	lock_inode(inode);
+	if (inode->i_dirt && inode->i_dev == sb->s_dev) {
+		pack_inode(sb->s_itable + inode->i_num,inode);
+		inode->i_dirt=inode->i_ddirt=0;
+	}
+	unlock_inode(inode);
+}
+
+/*
+ * write_inodes() copies 'n' inodes that live in the same inode block into
+ * it, reading the block only once. bread() may sleep, so each inode is
+ * checked again under its lock: one that has been cleaned or reused in
+ * the meantime is skipped.
+ */
+static void write_inodes(struct m_inode ** list, int n)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	struct m_inode * inode;
+	int dev,block;
 
-	lock_inode(inode);
-	if (!inode->i_dirt || !inode->i_dev) {
-		unlock_inode(inode);
+	if (!(dev = list[0]->i_dev))
 		return;
-	}
-	if (!(sb=get_super(inode->i_dev)))
+	block = list[0]->i_num;
+	if (!(sb=get_super(dev)))
 		panic("trying to write inode without device");
-	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
-	if (!(bh=bread(inode->i_dev,block)))
+	if (IS_TMP(dev)) {
+		while (n--)
+			tmp_write_inode(sb,*(list++));
+		return;
+	}
+	block = inode_block(sb,block);
+	if (!(bh=bread(dev,block)))
 		panic("unable to read i-node block");
-	((struct d_inode *)bh->b_data)
-		[(inode->i_num-1)%INODES_PER_BLOCK] =
-			*(struct d_inode *)inode;
-	bh->b_dirt=1;
-	inode->i_dirt=0;
+	while (n--) {
+		inode = *(list++);
+		lock_inode(inode);
+		if (inode->i_dirt && inode->i_dev == dev &&
+		    inode_block(sb,inode->i_num) == block) {
+			put_d_inode(sb,bh->b_data,inode->i_num,inode);
+			bh->b_dirt=1;
+			inode->i_dirt=inode->i_ddirt=0;
+		}
+		unlock_inode(inode);
+	}
 	brelse(bh);
-	unlock_inode(inode);
+}
+
+static void write_inode(struct m_inode * inode)
+{
+	write_inodes(&inode,1);
+}
+
+/*
+ * sync_inode() copies the inode into its buffer if it is dirty, and
+ * returns the number of that block, so that fsync can write it out.
+ */
+int sync_inode(struct m_inode * inode)
+{
+	struct super_block * sb;
+
+	wait_on_inode(inode);
+	if (inode->i_dirt)
+		write_inode(inode);
+	if (!(sb=get_super(inode->i_dev)))
+		panic("trying to sync inode without device");
+	if (IS_TMP(inode->i_dev))
+		return 0;
+	return inode_block(sb,inode->i_num);
 }
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <const.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 
 #define ACC_MODE(x) ("\004\002\006\377"[(x)&O_ACCMODE])
 
@@ -26,9 +27,9 @@
  */
 /* #define NO_TRUNCATE */
 
-#define MAY_EXEC 1
-#define MAY_WRITE 2
-#define MAY_READ 4
+/* a compressed filesystem is read-only, but not the devices on it */
+#define CFS_RDONLY(inode) (IS_CFS((inode)->i_dev) && \
+	!S_ISCHR((inode)->i_mode) && !S_ISBLK((inode)->i_mode))
 
 /*
  *	permission()
@@ -37,14 +38,14 @@
  * I don't know if we should look at just the euid or both euid and
  * uid, but that should be easily changed.
  */
-static int permission(struct m_inode * inode,int mask)
+int permission(struct m_inode * inode,int mask)
 {
 	int mode = inode->i_mode;
 
 /* special case: not even root can read/write a deleted file */
 	if (inode->i_dev && !inode->i_nlinks)
 		return 0;
-	else if (current->euid==inode->i_uid)
+	if (current->euid==inode->i_uid)
 		mode >>= 6;
 	else if (current->egid==inode->i_gid)
 		mode >>= 3;
@@ -77,6 +78,102 @@ static int match(int len,const char * name,struct dir_entry * de)
 	return same;
 }
 
+/*
+ * dir_buckets() returns the number of hashed blocks of a directory, or 0
+ * if it is a plain linear one. 'bh' is the first block of the directory.
+ */
+static int dir_buckets(struct m_inode * dir, struct buffer_head * bh)
+{
+	struct dir_hash * h;
+
+	h = (struct dir_hash *) (bh->b_data + 2*sizeof (struct dir_entry));
+	if (h->inode || h->zero || h->magic != DIR_HASH_MAGIC || !h->buckets)
+		return 0;
+	if ((h->buckets+1)*BLOCK_SIZE > dir->i_size)
+		return 0;
+	return h->buckets;
+}
+
+/*
+ * NOTE! tools/dirhash.c has to use the same hash function.
+ */
+static unsigned long dir_hash(const char * name, int len)
+{
+	unsigned long h = 0;
+
+	while (len-- > 0)
+		h = (h<<5) - h + get_fs_byte(name++);
+	return h;
+}
+
+/*
+ * In a hashed directory an entry is placed in the first block of its
+ * probe sequence that has a free slot. Deleted entries keep their name
+ * (only the inode is cleared), so a lookup can stop at the first block
+ * that has a slot that was never used at all.
+ */
+static struct buffer_head * hash_find(struct m_inode * dir, int buckets,
+	const char * name, int namelen, struct dir_entry ** res_dir)
+{
+	int i,j,k,block,unused;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+
+	k = dir_hash(name,namelen) % buckets;
+	for (i=0 ; i<buckets ; i++,k = (k+1) % buckets) {
+		if (!(block = bmap(dir,1+k)) ||
+		    !(bh = bread(dir->i_dev,block)))
+			return NULL;
+		unused = 0;
+		de = (struct dir_entry *) bh->b_data;
+		for (j=0 ; j<DIR_ENTRIES_PER_BLOCK ; j++,de++) {
+			if (match(namelen,name,de)) {
+				*res_dir = de;
+				return bh;
+			}
+			if (!de->inode && !de->name[0])
+				unused = 1;
+		}
+		brelse(bh);
+		if (unused)
+			return NULL;
+	}
+	return NULL;
+}
+
+/*
+ * hash_add() returns 0 and the block in *res_bh, 1 if every bucket is
+ * full, or an error if a bucket couldn't be mapped or read.
+ */
+static int hash_add(struct m_inode * dir, int buckets, const char * name,
+	int namelen, struct buffer_head ** res_bh, struct dir_entry ** res_dir)
+{
+	int i,j,k,block;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+
+	k = dir_hash(name,namelen) % buckets;
+	for (i=0 ; i<buckets ; i++,k = (k+1) % buckets) {
+		if (!(block = create_block(dir,1+k)))
+			return -ENOSPC;
+		if (!(bh = bread(dir->i_dev,block)))
+			return -EIO;
+		de = (struct dir_entry *) bh->b_data;
+		for (j=0 ; j<DIR_ENTRIES_PER_BLOCK ; j++,de++)
+			if (!de->inode) {
+				dir->i_mtime = CURRENT_TIME;
+				for (j=0 ; j < NAME_LEN ; j++)
+					de->name[j]=(j<namelen)?get_fs_byte(name+j):0;
+				bh->b_dirt = 1;
+				*res_bh = bh;
+				*res_dir = de;
+				return 0;
+			}
+		brelse(bh);
+	}
+	return 1;
+}
+
 /*
  *	find_entry()
  *
@@ -92,7 +189,7 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 	const char * name, int namelen, struct dir_entry ** res_dir)
 {
 	int entries;
-	int block,i;
+	int block,i,buckets;
 	struct buffer_head * bh;
 	struct dir_entry * de;
 	struct super_block * sb;
@@ -124,12 +221,21 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
 			}
 		}
 	}
-	if (!(block = (*dir)->i_zone[0]))
+	if (!(block = bmap(*dir,0)))
 		return NULL;
 	if (!(bh = bread((*dir)->i_dev,block)))
 		return NULL;
 	i = 0;
 	de = (struct dir_entry *) bh->b_data;
+	if ((buckets = dir_buckets(*dir,bh))) {
+		for ( ; i<2 ; i++,de++)
+			if (match(namelen,name,de)) {
+				*res_dir = de;
+				return bh;
+			}
+		brelse(bh);
+		return hash_find(*dir,buckets,name,namelen,res_dir);
+	}
 	while (i < entries) {
 		if ((char *)de >= BLOCK_SIZE+bh->b_data) {
 			brelse(bh);
@@ -156,20 +262,22 @@ static struct buffer_head * find_entry(struct m_inode ** dir,
  *	add_entry()
  *
  * adds a file entry to the specified directory, using the same
- * semantics as find_entry(). It returns NULL if it failed.
+ * semantics as find_entry(). It returns NULL if it failed, with the
+ * error in *err.
  *
  * NOTE!! The inode part of 'de' is left at 0 - which means you
  * may not sleep between calling this and putting something into
  * the entry, as someone else might have used it while you slept.
  */
 static struct buffer_head * add_entry(struct m_inode * dir,
-	const char * name, int namelen, struct dir_entry ** res_dir)
+	const char * name, int namelen, struct dir_entry ** res_dir, int * err)
 {
-	int block,i;
+	int block,i,buckets;
 	struct buffer_head * bh;
 	struct dir_entry * de;
 
 	*res_dir = NULL;
+	*err = -ENOENT;
 #ifdef NO_TRUNCATE
 	if (namelen > NAME_LEN)
 		return NULL;
@@ -179,10 +287,28 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 #endif
 	if (!namelen)
 		return NULL;
-	if (!(block = dir->i_zone[0]))
+	*err = -EIO;
+	if (!(block = bmap(dir,0)))
 		return NULL;
 	if (!(bh = bread(dir->i_dev,block)))
 		return NULL;
+	if ((buckets = dir_buckets(dir,bh))) {
+		brelse(bh);
+		if ((i = hash_add(dir,buckets,name,namelen,&bh,res_dir)) < 0) {
+			*err = i;
+			return NULL;
+		}
+		if (!i) {
+			notify(dir,IN_CREATE,name,namelen);
+			return bh;
+		}
+/* every bucket is full: drop the index, go linear */
+		if (!(bh = bread(dir->i_dev,block)))
+			return NULL;
+		((struct dir_hash *) (bh->b_data +
+			2*sizeof (struct dir_entry)))->magic = 0;
+		bh->b_dirt = 1;
+	}
 	i = 0;
 	de = (struct dir_entry *) bh->b_data;
 	while (1) {
@@ -190,8 +316,10 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 			brelse(bh);
 			bh = NULL;
 			block = create_block(dir,i/DIR_ENTRIES_PER_BLOCK);
-			if (!block)
+			if (!block) {
+				*err = -ENOSPC;
 				return NULL;
+			}
 			if (!(bh = bread(dir->i_dev,block))) {
 				i += DIR_ENTRIES_PER_BLOCK;
 				continue;
@@ -201,7 +329,7 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 		if (i*sizeof(struct dir_entry) >= dir->i_size) {
 			de->inode=0;
 			dir->i_size = (i+1)*sizeof(struct dir_entry);
-			dir->i_dirt = 1;
+			dir->i_dirt = dir->i_ddirt = 1;
 			dir->i_ctime = CURRENT_TIME;
 		}
 		if (!de->inode) {
@@ -210,6 +338,7 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
 			bh->b_dirt = 1;
 			*res_dir = de;
+			notify(dir,IN_CREATE,name,namelen);
 			return bh;
 		}
 		de++;
@@ -338,7 +467,7 @@ int open_namei(const char * pathname, int flag, int mode,
 	struct m_inode ** res_inode)
 {
 	const char * basename;
-	int inr,dev,namelen;
+	int inr,dev,namelen,err;
 	struct m_inode * dir, *inode;
 	struct buffer_head * bh;
 	struct dir_entry * de;
@@ -363,11 +492,15 @@ int open_namei(const char * pathname, int flag, int mode,
 			iput(dir);
 			return -ENOENT;
 		}
+		if (CFS_RDONLY(dir)) {
+			iput(dir);
+			return -EROFS;
+		}
 		if (!permission(dir,MAY_WRITE)) {
 			iput(dir);
 			return -EACCES;
 		}
-		inode = new_inode(dir->i_dev);
+		inode = new_inode(dir);
 		if (!inode) {
 			iput(dir);
 			return -ENOSPC;
@@ -375,12 +508,12 @@ int open_namei(const char * pathname, int flag, int mode,
 		inode->i_uid = current->euid;
 		inode->i_mode = mode;
 		inode->i_dirt = 1;
-		bh = add_entry(dir,basename,namelen,&de);
+		bh = add_entry(dir,basename,namelen,&de,&err);
 		if (!bh) {
 			inode->i_nlinks--;
 			iput(inode);
 			iput(dir);
-			return -ENOSPC;
+			return err;
 		}
 		de->inode = inode->i_num;
 		bh->b_dirt = 1;
@@ -397,14 +530,20 @@ int open_namei(const char * pathname, int flag, int mode,
 		return -EEXIST;
 	if (!(inode=iget(dev,inr)))
 		return -EACCES;
+	if ((ACC_MODE(flag) & MAY_WRITE) && CFS_RDONLY(inode)) {
+		iput(inode);
+		return -EROFS;
+	}
 	if ((S_ISDIR(inode->i_mode) && (flag & O_ACCMODE)) ||
 	    !permission(inode,ACC_MODE(flag))) {
 		iput(inode);
 		return -EPERM;
 	}
 	inode->i_atime = CURRENT_TIME;
-	if (flag & O_TRUNC)
+	if (flag & O_TRUNC) {
 		truncate(inode);
+		notify(inode,IN_MODIFY,NULL,0);
+	}
 	*res_inode = inode;
 	return 0;
 }
@@ -412,7 +551,7 @@ int open_namei(const char * pathname, int flag, int mode,
 int sys_mknod(const char * filename, int mode, int dev)
 {
 	const char * basename;
-	int namelen;
+	int namelen,err;
 	struct m_inode * dir, * inode;
 	struct buffer_head * bh;
 	struct dir_entry * de;
@@ -425,6 +564,10 @@ int sys_mknod(const char * filename, int mode, int dev)
 		iput(dir);
 		return -ENOENT;
 	}
+	if (CFS_RDONLY(dir)) {
+		iput(dir);
+		return -EROFS;
+	}
 	if (!permission(dir,MAY_WRITE)) {
 		iput(dir);
 		return -EPERM;
@@ -435,7 +578,7 @@ int sys_mknod(const char * filename, int mode, int dev)
 		iput(dir);
 		return -EEXIST;
 	}
-	inode = new_inode(dir->i_dev);
+	inode = new_inode(dir);
 	if (!inode) {
 		iput(dir);
 		return -ENOSPC;
@@ -445,12 +588,12 @@ int sys_mknod(const char * filename, int mode, int dev)
 		inode->i_zone[0] = dev;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
 	inode->i_dirt = 1;
-	bh = add_entry(dir,basename,namelen,&de);
+	bh = add_entry(dir,basename,namelen,&de,&err);
 	if (!bh) {
 		iput(dir);
 		inode->i_nlinks=0;
 		iput(inode);
-		return -ENOSPC;
+		return err;
 	}
 	de->inode = inode->i_num;
 	bh->b_dirt = 1;
@@ -463,7 +606,7 @@ int sys_mknod(const char * filename, int mode, int dev)
 int sys_mkdir(const char * pathname, int mode)
 {
 	const char * basename;
-	int namelen;
+	int namelen,block,err;
 	struct m_inode * dir, * inode;
 	struct buffer_head * bh, *dir_block;
 	struct dir_entry * de;
@@ -476,6 +619,10 @@ int sys_mkdir(const char * pathname, int mode)
 		iput(dir);
 		return -ENOENT;
 	}
+	if (CFS_RDONLY(dir)) {
+		iput(dir);
+		return -EROFS;
+	}
 	if (!permission(dir,MAY_WRITE)) {
 		iput(dir);
 		return -EPERM;
@@ -486,7 +633,7 @@ int sys_mkdir(const char * pathname, int mode)
 		iput(dir);
 		return -EEXIST;
 	}
-	inode = new_inode(dir->i_dev);
+	inode = new_inode(dir);
 	if (!inode) {
 		iput(dir);
 		return -ENOSPC;
@@ -494,14 +641,14 @@ int sys_mkdir(const char * pathname, int mode)
 	inode->i_size = 32;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_zone[0]=new_block(inode->i_dev))) {
+	if (!(block=create_block(inode,0))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
 		return -ENOSPC;
 	}
 	inode->i_dirt = 1;
-	if (!(dir_block=bread(inode->i_dev,inode->i_zone[0]))) {
+	if (!(dir_block=bread(inode->i_dev,block))) {
 		iput(dir);
 		free_block(inode->i_dev,inode->i_zone[0]);
 		inode->i_nlinks--;
@@ -519,13 +666,13 @@ int sys_mkdir(const char * pathname, int mode)
 	brelse(dir_block);
 	inode->i_mode = I_DIRECTORY | (mode & 0777 & ~current->umask);
 	inode->i_dirt = 1;
-	bh = add_entry(dir,basename,namelen,&de);
+	bh = add_entry(dir,basename,namelen,&de,&err);
 	if (!bh) {
 		iput(dir);
 		free_block(inode->i_dev,inode->i_zone[0]);
 		inode->i_nlinks=0;
 		iput(inode);
-		return -ENOSPC;
+		return err;
 	}
 	de->inode = inode->i_num;
 	bh->b_dirt = 1;
@@ -548,8 +695,8 @@ static int empty_dir(struct m_inode * inode)
 	struct dir_entry * de;
 
 	len = inode->i_size / sizeof (struct dir_entry);
-	if (len<2 || !inode->i_zone[0] ||
-	    !(bh=bread(inode->i_dev,inode->i_zone[0]))) {
+	if (len<2 || !(block=bmap(inode,0)) ||
+	    !(bh=bread(inode->i_dev,block))) {
 	    	printk("warning - bad directory on dev %04x\n",inode->i_dev);
 		return 0;
 	}
@@ -600,6 +747,10 @@ int sys_rmdir(const char * name)
 		iput(dir);
 		return -ENOENT;
 	}
+	if (CFS_RDONLY(dir)) {
+		iput(dir);
+		return -EROFS;
+	}
 	if (!permission(dir,MAY_WRITE)) {
 		iput(dir);
 		return -EPERM;
@@ -655,6 +806,7 @@ int sys_rmdir(const char * name)
 	dir->i_nlinks--;
 	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
 	dir->i_dirt=1;
+	notify(dir,IN_DELETE,basename,namelen);
 	iput(dir);
 	iput(inode);
 	return 0;
@@ -674,6 +826,10 @@ int sys_unlink(const char * name)
 		iput(dir);
 		return -ENOENT;
 	}
+	if (CFS_RDONLY(dir)) {
+		iput(dir);
+		return -EROFS;
+	}
 	if (!permission(dir,MAY_WRITE)) {
 		iput(dir);
 		return -EPERM;
@@ -713,6 +869,8 @@ int sys_unlink(const char * name)
 	inode->i_nlinks--;
 	inode->i_dirt = 1;
 	inode->i_ctime = CURRENT_TIME;
+	notify(dir,IN_DELETE,basename,namelen);
+	notify(inode,IN_ATTRIB,NULL,0);
 	iput(inode);
 	iput(dir);
 	return 0;
@@ -724,7 +882,7 @@ int sys_link(const char * oldname, const char * newname)
 	struct m_inode * oldinode, * dir;
 	struct buffer_head * bh;
 	const char * basename;
-	int namelen;
+	int namelen,err;
 
 	oldinode=namei(oldname);
 	if (!oldinode)
@@ -748,6 +906,11 @@ int sys_link(const char * oldname, const char * newname)
 		iput(oldinode);
 		return -EXDEV;
 	}
+	if (CFS_RDONLY(dir)) {
+		iput(dir);
+		iput(oldinode);
+		return -EROFS;
+	}
 	if (!permission(dir,MAY_WRITE)) {
 		iput(dir);
 		iput(oldinode);
@@ -760,11 +923,11 @@ int sys_link(const char * oldname, const char * newname)
 		iput(oldinode);
 		return -EEXIST;
 	}
-	bh = add_entry(dir,basename,namelen,&de);
+	bh = add_entry(dir,basename,namelen,&de,&err);
 	if (!bh) {
 		iput(dir);
 		iput(oldinode);
-		return -ENOSPC;
+		return err;
 	}
 	de->inode = oldinode->i_num;
 	bh->b_dirt = 1;
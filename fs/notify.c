@@ -0,0 +1,268 @@
+/*
+ *  linux/fs/notify.c
+ */
+
+/*
+ * inotify: instead of polling a directory with stat(), a process gets
+ * a file descriptor from inotify_init(), puts watches on inodes with
+ * inotify_add_watch(), and read()s events from it, sleeping until there
+ * are some.
+ *
+ * The descriptor's inode is a queue much like a pipe: a page of events,
+ * with the head and tail (counted in events) in i_zone[0] and i_zone[1].
+ * Watches name an inode by device and number, so that they don't keep it
+ * in the inode table, and go away when the inode is freed or its device
+ * unmounted. A repeat of
+ * the last event queued is dropped, and when the queue is full the
+ * events are lost, after a last IN_Q_OVERFLOW.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/segment.h>
+
+#define NR_WATCH 64
+#define NR_EVENTS (PAGE_SIZE/sizeof (struct inotify_event))
+
+#define EV_HEAD(inode) PIPE_HEAD(inode)
+#define EV_TAIL(inode) PIPE_TAIL(inode)
+#define EV_SIZE(inode) ((EV_HEAD(inode)+NR_EVENTS-EV_TAIL(inode))%NR_EVENTS)
+#define EV(inode,n) (((struct inotify_event *) (inode).i_size)+(n))
+
+static struct watch {
+	struct m_inode * w_queue;	/* NULL if the slot is free */
+	unsigned short w_dev;
+	unsigned short w_num;
+	unsigned long w_mask;
+} watch_table[NR_WATCH];
+
+static int nr_watches = 0;
+
+/* 'name' is in user space, like the names add_entry() gets */
+static void queue_event(struct m_inode * q, int wd, unsigned long mask,
+	const char * name, int len)
+{
+	struct inotify_event * ev;
+	int i;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	if (EV_SIZE(*q)) {
+		ev = EV(*q,(EV_HEAD(*q)+NR_EVENTS-1)%NR_EVENTS);
+		if (ev->mask == IN_Q_OVERFLOW)
+			return;
+		if (ev->wd == wd && ev->mask == mask && ev->len == len) {
+			for (i=0 ; i<len && ev->name[i] == get_fs_byte(name+i) ; i++)
+				/* nothing */ ;
+			if (i == len)
+				return;
+		}
+	}
+	if (EV_SIZE(*q) >= NR_EVENTS-2) {
+		wd = -1;
+		mask = IN_Q_OVERFLOW;
+		len = 0;
+	}
+	ev = EV(*q,EV_HEAD(*q));
+	ev->wd = wd;
+	ev->mask = mask;
+	ev->len = len;
+	for (i=0 ; i<NAME_LEN ; i++)
+		ev->name[i] = (i<len) ? get_fs_byte(name+i) : 0;
+	EV_HEAD(*q) = (EV_HEAD(*q)+1) % NR_EVENTS;
+	wake_up(&q->i_wait);
+}
+
+/*
+ * notify() queues event 'mask' for every watch on 'inode'. 'name' is the
+ * entry concerned when the inode is a directory. It doesn't sleep: see
+ * add_entry().
+ */
+void notify(struct m_inode * inode, unsigned long mask,
+	const char * name, int len)
+{
+	struct watch * w;
+
+	if (!nr_watches || !inode->i_dev)
+		return;
+	for (w = watch_table ; w < watch_table+NR_WATCH ; w++)
+		if (w->w_queue && (w->w_mask & mask) &&
+		    w->w_dev == inode->i_dev && w->w_num == inode->i_num)
+			queue_event(w->w_queue,w-watch_table+1,mask,name,len);
+}
+
+/* called by iput() when 'inode' is about to be freed */
+void notify_free(struct m_inode * inode)
+{
+	struct watch * w;
+
+	if (!nr_watches)
+		return;
+	notify(inode,IN_DELETE_SELF,NULL,0);
+	for (w = watch_table ; w < watch_table+NR_WATCH ; w++)
+		if (w->w_queue && w->w_dev == inode->i_dev &&
+		    w->w_num == inode->i_num) {
+			queue_event(w->w_queue,w-watch_table+1,IN_IGNORED,NULL,0);
+			w->w_queue = NULL;
+			nr_watches--;
+		}
+}
+
+/* called by iput() when the last descriptor of queue 'inode' is closed */
+void notify_release(struct m_inode * inode)
+{
+	struct watch * w;
+
+	for (w = watch_table ; w < watch_table+NR_WATCH ; w++)
+		if (w->w_queue == inode) {
+			w->w_queue = NULL;
+			nr_watches--;
+		}
+	free_page(inode->i_size);
+}
+
+/* called by umount(): the inode numbers are going to mean nothing */
+void notify_umount(int dev)
+{
+	struct watch * w;
+
+	if (!nr_watches)
+		return;
+	for (w = watch_table ; w < watch_table+NR_WATCH ; w++)
+		if (w->w_queue && w->w_dev == dev) {
+			queue_event(w->w_queue,w-watch_table+1,IN_UNMOUNT,NULL,0);
+			queue_event(w->w_queue,w-watch_table+1,IN_IGNORED,NULL,0);
+			w->w_queue = NULL;
+			nr_watches--;
+		}
+}
+
+int read_notify(struct m_inode * inode, struct file * filp,
+	char * buf, int count)
+{
+	unsigned long * ev;
+	int i,read = 0;
+
+	if (count < sizeof (struct inotify_event))
+		return -EINVAL;
+	while (!EV_SIZE(*inode)) {
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (current->signal & ~current->blocked)
+			return -EINTR;
+		interruptible_sleep_on(&inode->i_wait);
+	}
+	while (EV_SIZE(*inode) && count-read >= sizeof (struct inotify_event)) {
+		ev = (unsigned long *) EV(*inode,EV_TAIL(*inode));
+		for (i=0 ; i < sizeof (struct inotify_event)/4 ; i++)
+			put_fs_long(ev[i],(unsigned long *) (buf+read)+i);
+		read += sizeof (struct inotify_event);
+		EV_TAIL(*inode) = (EV_TAIL(*inode)+1) % NR_EVENTS;
+	}
+	return read;
+}
+
+int sys_inotify_init(void)
+{
+	struct m_inode * inode;
+	struct file * f;
+	int fd;
+
+	if ((fd = get_unused_fd(0)) < 0)
+		return fd;
+	if (!(f = get_empty_filp())) {
+		put_unused_fd(fd);
+		return -ENFILE;
+	}
+	if (!(inode = get_empty_inode())) {
+		put_unused_fd(fd);
+		put_filp(f);
+		return -ENFILE;
+	}
+	if (!(inode->i_size = get_free_page())) {
+		inode->i_count = 0;
+		put_unused_fd(fd);
+		put_filp(f);
+		return -ENOMEM;
+	}
+	EV_HEAD(*inode) = EV_TAIL(*inode) = 0;
+	inode->i_notify = 1;
+	current->filp[fd] = f;
+	f->f_inode = inode;
+	f->f_mode = 1;		/* read */
+	f->f_flags = O_RDONLY;
+	f->f_pos = 0;
+	return fd;
+}
+
+static struct m_inode * get_queue(unsigned int fd)
+{
+	struct file * file;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]) ||
+	    !file->f_inode)
+		return NULL;
+	return file->f_inode->i_notify ? file->f_inode : NULL;
+}
+
+int sys_inotify_add_watch(unsigned int fd, const char * pathname,
+	unsigned long mask)
+{
+	struct m_inode * q, * inode;
+	struct watch * w, * empty = NULL;
+
+	if (!(q = get_queue(fd)))
+		return -EBADF;
+	if (!(mask &= IN_ALL_EVENTS))
+		return -EINVAL;
+	if (!(inode = namei(pathname)))
+		return -ENOENT;
+	if (!permission(inode,MAY_READ)) {
+		iput(inode);
+		return -EACCES;
+	}
+	for (w = watch_table ; w < watch_table+NR_WATCH ; w++) {
+		if (!w->w_queue) {
+			if (!empty)
+				empty = w;
+			continue;
+		}
+		if (w->w_queue == q && w->w_dev == inode->i_dev &&
+		    w->w_num == inode->i_num) {
+			empty = w;
+			nr_watches--;
+			break;
+		}
+	}
+	if (!empty) {
+		iput(inode);
+		return -ENOSPC;
+	}
+	empty->w_queue = q;
+	empty->w_dev = inode->i_dev;
+	empty->w_num = inode->i_num;
+	empty->w_mask = mask;
+	nr_watches++;
+	iput(inode);
+	return empty-watch_table+1;
+}
+
+int sys_inotify_rm_watch(unsigned int fd, int wd)
+{
+	struct m_inode * q;
+	struct watch * w;
+
+	if (!(q = get_queue(fd)))
+		return -EBADF;
+	if (wd < 1 || wd > NR_WATCH || (w = watch_table+wd-1)->w_queue != q)
+		return -EINVAL;
+	queue_event(q,wd,IN_IGNORED,NULL,0);
+	w->w_queue = NULL;
+	nr_watches--;
+	return 0;
+}
@@ -10,6 +10,8 @@
 #include <sys/types.h>
 #include <utime.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/inotify.h>
 
 #include <linux/sched.h>
 #include <linux/tty.h>
@@ -18,7 +20,62 @@
 
 int sys_ustat(int dev, struct ustat * ubuf)
 {
-	return -ENOSYS;
+	struct super_block * sb;
+	struct ustat tmp;
+	int i;
+
+	if (!(sb=get_super(dev)))
+		return -EINVAL;
+	verify_area(ubuf,sizeof (*ubuf));
+	tmp.f_tfree = sb->s_free_zones << sb->s_log_zone_size;
+	tmp.f_tinode = sb->s_free_inodes;
+	for (i=0 ; i<6 ; i++)
+		tmp.f_fname[i] = tmp.f_fpack[i] = 0;
+	for (i=0 ; i<sizeof (tmp) ; i++)
+		put_fs_byte(((char *) &tmp)[i],&((char *) ubuf)[i]);
+	return 0;
+}
+
+static int cp_statfs(int dev, struct statfs * buf)
+{
+	struct super_block * sb;
+	struct statfs tmp;
+	int i;
+
+	if (!(sb=get_super(dev)))
+		return -ENODEV;
+	verify_area(buf,sizeof (*buf));
+	tmp.f_type = sb->s_magic;
+	tmp.f_bsize = BLOCK_SIZE << sb->s_log_zone_size;
+	tmp.f_blocks = sb->s_nzones - sb->s_firstdatazone;
+	tmp.f_bfree = tmp.f_bavail = sb->s_free_zones;
+	tmp.f_files = sb->s_ninodes;
+	tmp.f_ffree = sb->s_free_inodes;
+	tmp.f_namelen = NAME_LEN;
+	for (i=0 ; i<sizeof (tmp) ; i++)
+		put_fs_byte(((char *) &tmp)[i],&((char *) buf)[i]);
+	return 0;
+}
+
+int sys_statfs(const char * path, struct statfs * buf)
+{
+	struct m_inode * inode;
+	int dev;
+
+	if (!(inode=namei(path)))
+		return -ENOENT;
+	dev = inode->i_dev;
+	iput(inode);
+	return cp_statfs(dev,buf);
+}
+
+int sys_fstatfs(unsigned int fd, struct statfs * buf)
+{
+	struct file * f;
+
+	if (fd >= current->max_fds || !(f=current->filp[fd]) || !f->f_inode)
+		return -EBADF;
+	return cp_statfs(f->f_inode->i_dev,buf);
 }
 
 int sys_utime(char * filename, struct utimbuf * times)
@@ -28,6 +85,10 @@ int sys_utime(char * filename, struct utimbuf * times)
 
 	if (!(inode=namei(filename)))
 		return -ENOENT;
+	if (IS_CFS(inode->i_dev)) {
+		iput(inode);
+		return -EROFS;
+	}
 	if (times) {
 		actime = get_fs_long((unsigned long *) &times->actime);
 		modtime = get_fs_long((unsigned long *) &times->modtime);
@@ -112,8 +173,13 @@ int sys_chmod(const char * filename,int mode)
 		iput(inode);
 		return -EACCES;
 	}
+	if (IS_CFS(inode->i_dev)) {
+		iput(inode);
+		return -EROFS;
+	}
 	inode->i_mode = (mode & 07777) | (inode->i_mode & ~07777);
 	inode->i_dirt = 1;
+	notify(inode,IN_ATTRIB,NULL,0);
 	iput(inode);
 	return 0;
 }
@@ -128,9 +194,14 @@ int sys_chown(const char * filename,int uid,int gid)
 		iput(inode);
 		return -EACCES;
 	}
+	if (IS_CFS(inode->i_dev)) {
+		iput(inode);
+		return -EROFS;
+	}
 	inode->i_uid=uid;
 	inode->i_gid=gid;
 	inode->i_dirt=1;
+	notify(inode,IN_ATTRIB,NULL,0);
 	iput(inode);
 	return 0;
 }
@@ -142,21 +213,17 @@ int sys_open(const char * filename,int flag,int mode)
 	int i,fd;
 
 	mode &= 0777 & ~current->umask;
-	for(fd=0 ; fd<NR_OPEN ; fd++)
-		if (!current->filp[fd])
-			break;
-	if (fd>=NR_OPEN)
-		return -EINVAL;
-	current->close_on_exec &= ~(1<<fd);
-	f=0+file_table;
-	for (i=0 ; i<NR_FILE ; i++,f++)
-		if (!f->f_count) break;
-	if (i>=NR_FILE)
-		return -EINVAL;
-	(current->filp[fd]=f)->f_count++;
+	if ((fd=get_unused_fd(0))<0)
+		return fd;
+	if (!(f=get_empty_filp())) {
+		put_unused_fd(fd);
+		return -ENFILE;
+	}
+	current->filp[fd]=f;
 	if ((i=open_namei(filename,flag,mode,&inode))<0) {
 		current->filp[fd]=NULL;
-		f->f_count=0;
+		put_unused_fd(fd);
+		put_filp(f);
 		return i;
 	}
 /* ttys are somewhat special (ttyxx major==4, tty major==5) */
@@ -170,7 +237,8 @@ int sys_open(const char * filename,int flag,int mode)
 			if (current->tty<0) {
 				iput(inode);
 				current->filp[fd]=NULL;
-				f->f_count=0;
+				put_unused_fd(fd);
+				put_filp(f);
 				return -EPERM;
 			}
 	}
@@ -194,16 +262,15 @@ int sys_close(unsigned int fd)
 {	
 	struct file * filp;
 
-	if (fd >= NR_OPEN)
-		return -EINVAL;
-	current->close_on_exec &= ~(1<<fd);
-	if (!(filp = current->filp[fd]))
+	if (fd >= current->max_fds || !(filp = current->filp[fd]))
 		return -EINVAL;
 	current->filp[fd] = NULL;
+	put_unused_fd(fd);
 	if (filp->f_count == 0)
 		panic("Close: file count is 0");
 	if (--filp->f_count)
 		return (0);
 	iput(filp->f_inode);
+	put_filp(filp);
 	return (0);
 }
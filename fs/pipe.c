@@ -4,37 +4,101 @@
  *  (C) 1991  Linus Torvalds
  */
 
+#include <errno.h>
 #include <signal.h>
+#include <string.h>
 
 #include <linux/sched.h>
-#include <linux/mm.h>	/* for get_free_page */
+#include <linux/mm.h>	/* for get_free_pages */
 #include <asm/segment.h>
 
+/*
+ * Readers and writers both sleep on i_wait. Instead of waking the other
+ * side after every chunk, a sleeper says how much it waits for, and is
+ * only woken once that much is there, or the pipe has gone past the
+ * watermark for its side (see fs.h). Closing an end always wakes it.
+ */
+void pipe_wake(struct m_inode * inode)
+{
+	unsigned long size = PIPE_SIZE(*inode);
+
+	if ((PIPE_RWANT(*inode) && (size >= PIPE_RWANT(*inode) ||
+	     size >= PIPE_HIWAT(*inode))) ||
+	    (PIPE_WWANT(*inode) && (PIPE_ROOM(*inode) >= PIPE_WWANT(*inode) ||
+	     size <= PIPE_LOWAT(*inode)))) {
+		PIPE_RWANT(*inode) = PIPE_WWANT(*inode) = 0;
+		wake_up(&inode->i_wait);
+	}
+}
+
+/*
+ * Each end is locked for the whole of a read or write: the copies can
+ * sleep on a page fault, and head and tail are only moved once the bytes
+ * are there, so two readers (or writers) mustn't share a range.
+ */
+void pipe_lock(struct m_inode * inode, int rw)
+{
+	unsigned long * lock;
+
+	lock = (rw == READ) ? &PIPE_RLOCK(*inode) : &PIPE_WLOCK(*inode);
+	while (*lock) {
+		*lock = 2;	/* someone is waiting */
+		sleep_on(&inode->i_wait);
+	}
+	*lock = 1;
+}
+
+void pipe_unlock(struct m_inode * inode, int rw)
+{
+	unsigned long * lock;
+	int waiting;
+
+	lock = (rw == READ) ? &PIPE_RLOCK(*inode) : &PIPE_WLOCK(*inode);
+	waiting = *lock > 1;
+	*lock = 0;
+	if (waiting)
+		wake_up(&inode->i_wait);
+}
+
+void pipe_wait(struct m_inode * inode, int rw, int want)
+{
+	unsigned long * w;
+
+	w = (rw == READ) ? &PIPE_RWANT(*inode) : &PIPE_WWANT(*inode);
+	if (!*w || want < *w)
+		*w = want;
+	sleep_on(&inode->i_wait);
+}
+
 int read_pipe(struct m_inode * inode, char * buf, int count)
 {
 	int chars, size, read = 0;
 
+	pipe_lock(inode,READ);
 	while (count>0) {
 		while (!(size=PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+			pipe_wake(inode);
 			if (inode->i_count != 2) /* are there any writers? */
-				return read;
-			sleep_on(&inode->i_wait);
+				goto out;
+			pipe_wait(inode,READ,count);
 		}
-		chars = PAGE_SIZE-PIPE_TAIL(*inode);
+		chars = PIPE_BUF_SIZE(*inode)-PIPE_TAIL(*inode);
 		if (chars > count)
 			chars = count;
 		if (chars > size)
 			chars = size;
+		PIPE_BUSY(*inode)++;
+		memcpy_tofs(buf,PIPE_TAIL(*inode)+(char *)inode->i_size,chars);
+		PIPE_BUSY(*inode)--;
+		PIPE_TAIL(*inode) += chars;
+		PIPE_TAIL(*inode) &= (PIPE_BUF_SIZE(*inode)-1);
+		buf += chars;
 		count -= chars;
 		read += chars;
-		size = PIPE_TAIL(*inode);
-		PIPE_TAIL(*inode) += chars;
-		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			put_fs_byte(((char *)inode->i_size)[size++],buf++);
 	}
-	wake_up(&inode->i_wait);
+	pipe_wake(inode);
+out:
+	pipe_unlock(inode,READ);
 	return read;
 }
 	
@@ -42,65 +106,99 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 {
 	int chars, size, written = 0;
 
+	pipe_lock(inode,WRITE);
 	while (count>0) {
-		while (!(size=(PAGE_SIZE-1)-PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+		while (!(size=PIPE_ROOM(*inode))) {
+			pipe_wake(inode);
 			if (inode->i_count != 2) { /* no readers */
 				current->signal |= (1<<(SIGPIPE-1));
-				return written?written:-1;
+				if (!written)
+					written = -1;
+				goto out;
 			}
-			sleep_on(&inode->i_wait);
+			pipe_wait(inode,WRITE,count);
 		}
-		chars = PAGE_SIZE-PIPE_HEAD(*inode);
+		chars = PIPE_BUF_SIZE(*inode)-PIPE_HEAD(*inode);
 		if (chars > count)
 			chars = count;
 		if (chars > size)
 			chars = size;
+		PIPE_BUSY(*inode)++;
+		memcpy_fromfs(PIPE_HEAD(*inode)+(char *)inode->i_size,buf,
+			chars);
+		PIPE_BUSY(*inode)--;
+		PIPE_HEAD(*inode) += chars;
+		PIPE_HEAD(*inode) &= (PIPE_BUF_SIZE(*inode)-1);
+		buf += chars;
 		count -= chars;
 		written += chars;
-		size = PIPE_HEAD(*inode);
-		PIPE_HEAD(*inode) += chars;
-		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			((char *)inode->i_size)[size++]=get_fs_byte(buf++);
 	}
-	wake_up(&inode->i_wait);
+	pipe_wake(inode);
+out:
+	pipe_unlock(inode,WRITE);
 	return written;
 }
 
+/*
+ * fcntl(F_SETPIPE_SZ): the size is rounded up to a power of two pages.
+ * The data is moved to the start of the new buffer. This can't be done
+ * while someone is copying in or out of the old one, as the copy may
+ * sleep on a page fault.
+ */
+int pipe_resize(struct m_inode * inode, unsigned long size)
+{
+	unsigned long pages, page, n, chars;
+	char * old = (char *) inode->i_size;
+
+	for (pages=1 ; pages*PAGE_SIZE < size ; pages <<= 1)
+		/* nothing */ ;
+	if ((size = pages*PAGE_SIZE) > PIPE_MAX_SIZE)
+		return -EINVAL;
+	if (size == PIPE_BUF_SIZE(*inode))
+		return size;
+	if (PIPE_BUSY(*inode) || (n=PIPE_SIZE(*inode)) >= size)
+		return -EBUSY;
+	if (!(page = get_free_pages(pages)))
+		return -ENOMEM;
+	chars = PIPE_BUF_SIZE(*inode)-PIPE_TAIL(*inode);
+	if (chars > n)
+		chars = n;
+	memcpy((char *) page,old+PIPE_TAIL(*inode),chars);
+	memcpy((char *) page+chars,old,n-chars);
+	free_pages(inode->i_size,PIPE_BUF_SIZE(*inode)/PAGE_SIZE);
+	inode->i_size = page;
+	PIPE_BUF_SIZE(*inode) = size;
+	PIPE_TAIL(*inode) = 0;
+	PIPE_HEAD(*inode) = n;
+	pipe_wake(inode);
+	return size;
+}
+
 int sys_pipe(unsigned long * fildes)
 {
 	struct m_inode * inode;
 	struct file * f[2];
 	int fd[2];
-	int i,j;
-
-	j=0;
-	for(i=0;j<2 && i<NR_FILE;i++)
-		if (!file_table[i].f_count)
-			(f[j++]=i+file_table)->f_count++;
-	if (j==1)
-		f[0]->f_count=0;
-	if (j<2)
+
+	if (!(f[0]=get_empty_filp()))
 		return -1;
-	j=0;
-	for(i=0;j<2 && i<NR_OPEN;i++)
-		if (!current->filp[i]) {
-			current->filp[ fd[j]=i ] = f[j];
-			j++;
-		}
-	if (j==1)
-		current->filp[fd[0]]=NULL;
-	if (j<2) {
-		f[0]->f_count=f[1]->f_count=0;
+	if (!(f[1]=get_empty_filp())) {
+		put_filp(f[0]);
 		return -1;
 	}
+	if ((fd[0]=get_unused_fd(0))<0)
+		goto no_fd;
+	if ((fd[1]=get_unused_fd(0))<0) {
+		put_unused_fd(fd[0]);
+		goto no_fd;
+	}
 	if (!(inode=get_pipe_inode())) {
-		current->filp[fd[0]] =
-			current->filp[fd[1]] = NULL;
-		f[0]->f_count = f[1]->f_count = 0;
-		return -1;
+		put_unused_fd(fd[0]);
+		put_unused_fd(fd[1]);
+		goto no_fd;
 	}
+	current->filp[fd[0]] = f[0];
+	current->filp[fd[1]] = f[1];
 	f[0]->f_inode = f[1]->f_inode = inode;
 	f[0]->f_pos = f[1]->f_pos = 0;
 	f[0]->f_mode = 1;		/* read */
@@ -108,4 +206,8 @@ int sys_pipe(unsigned long * fildes)
 	put_fs_long(fd[0],0+fildes);
 	put_fs_long(fd[1],1+fildes);
 	return 0;
+no_fd:
+	put_filp(f[0]);
+	put_filp(f[1]);
+	return -1;
 }
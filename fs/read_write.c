@@ -6,7 +6,10 @@
 
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
 
 #include <linux/kernel.h>
 #include <linux/sched.h>
@@ -15,20 +18,52 @@
 extern int rw_char(int rw,int dev, char * buf, int count, off_t * pos);
 extern int read_pipe(struct m_inode * inode, char * buf, int count);
 extern int write_pipe(struct m_inode * inode, char * buf, int count);
+extern int read_notify(struct m_inode * inode, struct file * filp,
+		char * buf, int count);
 extern int block_read(int dev, off_t * pos, char * buf, int count);
 extern int block_write(int dev, off_t * pos, char * buf, int count);
 extern int file_read(struct m_inode * inode, struct file * filp,
 		char * buf, int count);
 extern int file_write(struct m_inode * inode, struct file * filp,
 		char * buf, int count);
+extern void file_readahead(struct m_inode * inode, off_t pos, int count);
+extern int block_direct(int rw, int dev, off_t * pos, char * buf, int count);
+extern int file_direct(int rw, struct m_inode * inode, struct file * filp,
+		char * buf, int count);
+
+/*
+ * SEEK_DATA and SEEK_HOLE go to the next zone of the file that is mapped,
+ * or not, at or after 'offset'. The end of file counts as a hole.
+ */
+static int seek_data(struct m_inode * inode, off_t offset, int data)
+{
+	struct super_block * sb;
+	int shift,zone,last;
+
+	if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode))
+		return -EINVAL;
+	if (offset < 0 || offset >= inode->i_size)
+		return -ENXIO;
+	if (!(sb = get_super(inode->i_dev)))
+		return -ENODEV;
+	flush_dalloc(inode);
+	shift = BLOCK_SIZE_BITS + sb->s_log_zone_size;
+	last = ((inode->i_size-1) >> shift) + 1;
+	zone = find_zone(inode,offset >> shift,last,data);
+	if (zone >= last)
+		return data ? -ENXIO : inode->i_size;
+	if (zone == offset >> shift)
+		return offset;
+	return zone << shift;
+}
 
 int sys_lseek(unsigned int fd,off_t offset, int origin)
 {
 	struct file * file;
 	int tmp;
 
-	if (fd >= NR_OPEN || !(file=current->filp[fd]) || !(file->f_inode)
-	   || !IS_SEEKABLE(MAJOR(file->f_inode->i_dev)))
+	if (fd >= current->max_fds || !(file=current->filp[fd]) ||
+	   !(file->f_inode) || !IS_SEEKABLE(MAJOR(file->f_inode->i_dev)))
 		return -EBADF;
 	if (file->f_inode->i_pipe)
 		return -ESPIPE;
@@ -46,58 +81,364 @@ int sys_lseek(unsigned int fd,off_t offset, int origin)
 				return -EINVAL;
 			file->f_pos = tmp;
 			break;
+		case 3:		/* SEEK_DATA */
+		case 4:		/* SEEK_HOLE */
+			if ((tmp = seek_data(file->f_inode,offset,
+			    origin == 3)) < 0)
+				return tmp;
+			file->f_pos = tmp;
+			break;
 		default:
 			return -EINVAL;
 	}
 	return file->f_pos;
 }
 
-int sys_read(unsigned int fd,char * buf,int count)
+/*
+ * do_read() and do_write() are read() and write() after the argument
+ * checks. 'file' may be a private copy of the real one, see pread().
+ */
+static int do_read(struct file * file, char * buf, int count)
 {
-	struct file * file;
 	struct m_inode * inode;
+	int gen;
 
-	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
-		return -EINVAL;
-	if (!count)
-		return 0;
-	verify_area(buf,count);
 	inode = file->f_inode;
 	if (inode->i_pipe)
 		return (file->f_mode&1)?read_pipe(inode,buf,count):-EIO;
+	if (inode->i_notify)
+		return read_notify(inode,file,buf,count);
 	if (S_ISCHR(inode->i_mode))
 		return rw_char(READ,inode->i_zone[0],buf,count,&file->f_pos);
-	if (S_ISBLK(inode->i_mode))
+	if (S_ISBLK(inode->i_mode)) {
+		if (file->f_flags & O_DIRECT)
+			return block_direct(READ,inode->i_zone[0],&file->f_pos,
+				buf,count);
 		return block_read(inode->i_zone[0],&file->f_pos,buf,count);
+	}
+	if (S_ISREG(inode->i_mode) && (file->f_flags & O_DIRECT)) {
+		gen = read_start(inode);
+		count = file_direct(READ,inode,file,buf,count);
+		read_end(inode,gen);
+		return count;
+	}
 	if (S_ISDIR(inode->i_mode) || S_ISREG(inode->i_mode)) {
 		if (count+file->f_pos > inode->i_size)
 			count = inode->i_size - file->f_pos;
 		if (count<=0)
 			return 0;
-		return file_read(inode,file,buf,count);
+		gen = read_start(inode);
+		count = file_read(inode,file,buf,count);
+		read_end(inode,gen);
+		return count;
 	}
 	printk("(Read)inode->i_mode=%06o\n\r",inode->i_mode);
 	return -EINVAL;
 }
 
-int sys_write(unsigned int fd,char * buf,int count)
+static int do_write(struct file * file, char * buf, int count)
 {
-	struct file * file;
 	struct m_inode * inode;
-	
-	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
-		return -EINVAL;
-	if (!count)
-		return 0;
+
 	inode=file->f_inode;
 	if (inode->i_pipe)
 		return (file->f_mode&2)?write_pipe(inode,buf,count):-EIO;
+	if (inode->i_notify)
+		return -EINVAL;
 	if (S_ISCHR(inode->i_mode))
 		return rw_char(WRITE,inode->i_zone[0],buf,count,&file->f_pos);
-	if (S_ISBLK(inode->i_mode))
+	if (S_ISBLK(inode->i_mode)) {
+		if (file->f_flags & O_DIRECT)
+			return block_direct(WRITE,inode->i_zone[0],&file->f_pos,
+				buf,count);
 		return block_write(inode->i_zone[0],&file->f_pos,buf,count);
-	if (S_ISREG(inode->i_mode))
-		return file_write(inode,file,buf,count);
+	}
+	if (S_ISREG(inode->i_mode)) {
+		inode->i_writers++;
+		inode->i_version++;
+		if (file->f_flags & O_DIRECT)
+			count = file_direct(WRITE,inode,file,buf,count);
+		else
+			count = file_write(inode,file,buf,count);
+		inode->i_version++;
+		inode->i_writers--;
+		if (count > 0)
+			notify(inode,IN_MODIFY,NULL,0);
+		return count;
+	}
 	printk("(Write)inode->i_mode=%06o\n\r",inode->i_mode);
 	return -EINVAL;
 }
+
+int sys_read(unsigned int fd,char * buf,int count)
+{
+	struct file * file;
+
+	if (fd >= current->max_fds || count<0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (!count)
+		return 0;
+	verify_area(buf,count);
+	return do_read(file,buf,count);
+}
+
+int sys_write(unsigned int fd,char * buf,int count)
+{
+	struct file * file;
+	
+	if (fd >= current->max_fds || count <0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (!count)
+		return 0;
+	return do_write(file,buf,count);
+}
+
+/*
+ * pread() and pwrite() have four arguments, but a system call only gets
+ * three: the buffer and count come in an iovec (lib/pread.c builds it).
+ * The transfer works on a copy of the file structure, so that f_pos is
+ * left alone even if somebody else shares the file meanwhile.
+ */
+static int do_pio(int rw, unsigned int fd, struct iovec * iov, off_t offset)
+{
+	struct file * file, tmp;
+	struct m_inode * inode;
+	char * buf;
+	int count;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]))
+		return -EINVAL;
+	inode = file->f_inode;
+	if (inode->i_pipe || S_ISCHR(inode->i_mode))
+		return -ESPIPE;
+	buf = (char *) get_fs_long((unsigned long *) &iov->iov_base);
+	count = get_fs_long((unsigned long *) &iov->iov_len);
+	if (count<0 || offset<0)
+		return -EINVAL;
+	if (!count)
+		return 0;
+	tmp = *file;
+	tmp.f_pos = offset;
+	if (rw == WRITE)
+		return do_write(&tmp,buf,count);
+	verify_area(buf,count);
+	return do_read(&tmp,buf,count);
+}
+
+int sys_pread(unsigned int fd, struct iovec * iov, off_t offset)
+{
+	return do_pio(READ,fd,iov,offset);
+}
+
+int sys_pwrite(unsigned int fd, struct iovec * iov, off_t offset)
+{
+	return do_pio(WRITE,fd,iov,offset);
+}
+
+/*
+ * readv() and writev() fetch and check the whole vector first. A readv()
+ * of a regular file then starts the reads of all its blocks at once, so
+ * that the segments are copied out of the cache one after the other, as
+ * for a single read() of the same size. A short transfer ends the call.
+ */
+static int do_rwv(int rw, unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	struct iovec v[UIO_MAXIOV];
+	struct file * file;
+	struct m_inode * inode;
+	int i,n,len,total = 0;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (iovcnt<0 || iovcnt>UIO_MAXIOV)
+		return -EINVAL;
+	for (i=0 ; i<iovcnt ; i++) {
+		v[i].iov_base = (void *) get_fs_long((unsigned long *)
+			&iov[i].iov_base);
+		v[i].iov_len = len = get_fs_long((unsigned long *)
+			&iov[i].iov_len);
+		if (len<0 || total+len<total)
+			return -EINVAL;
+		total += len;
+		if (rw == READ)
+			verify_area(v[i].iov_base,len);
+	}
+	inode = file->f_inode;
+	if (rw == READ && !inode->i_pipe && S_ISREG(inode->i_mode) &&
+	    !(file->f_flags & O_DIRECT))
+		file_readahead(inode,file->f_pos,total);
+	for (i=total=0 ; i<iovcnt ; i++) {
+		if (!(len = v[i].iov_len))
+			continue;
+		if (rw == READ)
+			n = do_read(file,v[i].iov_base,len);
+		else
+			n = do_write(file,v[i].iov_base,len);
+		if (n<0)
+			return total?total:n;
+		total += n;
+		if (n<len)
+			break;
+	}
+	return total;
+}
+
+int sys_readv(unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	return do_rwv(READ,fd,iov,iovcnt);
+}
+
+int sys_writev(unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	return do_rwv(WRITE,fd,iov,iovcnt);
+}
+
+/*
+ * sendfile() and splice() move data between two files without it going
+ * through user space: it's taken straight from the source's cache blocks
+ * or pipe page, and handed to the ordinary write routines with fs set to
+ * the kernel data segment. So it is copied just once, by the writer.
+ */
+static int file_send(struct m_inode * inode, off_t * pos, struct file * out,
+	int count)
+{
+	static char zeroes[BLOCK_SIZE];
+	struct buffer_head * bh;
+	unsigned long old_fs;
+	int block,chars,gen,n = 0,done = 0;
+
+	file_readahead(inode,*pos,count);
+	gen = read_start(inode);
+	while (count>0 && *pos < inode->i_size) {
+		chars = BLOCK_SIZE - *pos % BLOCK_SIZE;
+		if (chars > count)
+			chars = count;
+		if (chars > inode->i_size - *pos)
+			chars = inode->i_size - *pos;
+		bh = NULL;
+		if ((block = bmap(inode,*pos/BLOCK_SIZE))) {
+			if (!(bh = bread(inode->i_dev,block))) {
+				n = -EIO;
+				break;
+			}
+		} else
+			bh = get_dalloc(inode,*pos/BLOCK_SIZE);
+		old_fs = get_fs();
+		set_fs(get_ds());
+		n = do_write(out,(bh ? bh->b_data : zeroes) + *pos % BLOCK_SIZE,
+			chars);
+		set_fs(old_fs);
+		brelse(bh);
+		if (n<=0)
+			break;
+		*pos += n;
+		done += n;
+		count -= n;
+		if (n<chars)
+			break;
+	}
+	read_end(inode,gen);
+	if (!done && n<0)
+		return n;
+	inode->i_atime = CURRENT_TIME;
+	return done;
+}
+
+/* like read_pipe(), but it returns what it has instead of waiting for more */
+static int pipe_send(struct m_inode * pipe, struct file * out, int count)
+{
+	unsigned long old_fs;
+	int chars,size,n,done = 0;
+
+	pipe_lock(pipe,READ);
+	while (count>0) {
+		while (!(size=PIPE_SIZE(*pipe))) {
+			pipe_wake(pipe);
+			if (done || pipe->i_count != 2)
+				goto out;
+			pipe_wait(pipe,READ,1);
+		}
+		chars = PIPE_BUF_SIZE(*pipe)-PIPE_TAIL(*pipe);
+		if (chars > count)
+			chars = count;
+		if (chars > size)
+			chars = size;
+		old_fs = get_fs();
+		set_fs(get_ds());
+		PIPE_BUSY(*pipe)++;
+		n = do_write(out,(char *) pipe->i_size + PIPE_TAIL(*pipe),chars);
+		PIPE_BUSY(*pipe)--;
+		set_fs(old_fs);
+		if (n<=0) {
+			if (!done)
+				done = n;
+			break;
+		}
+		PIPE_TAIL(*pipe) += n;
+		PIPE_TAIL(*pipe) &= (PIPE_BUF_SIZE(*pipe)-1);
+		pipe_wake(pipe);
+		done += n;
+		count -= n;
+		if (n<chars)
+			break;
+	}
+	pipe_wake(pipe);
+out:
+	pipe_unlock(pipe,READ);
+	return done;
+}
+
+/*
+ * sendfile(out_fd, in_fd, offset, count) copies from a regular file. As a
+ * system call only gets three arguments, 'range' points to the offset and
+ * the count (lib/sendfile.c): an offset of -1 means the current position
+ * of in_fd, which is then moved on, otherwise the offset is updated.
+ */
+int sys_sendfile(unsigned int out_fd, unsigned int in_fd, off_t * range)
+{
+	struct file * in, * out;
+	off_t offset,pos;
+	int count,n;
+
+	if (out_fd >= current->max_fds || in_fd >= current->max_fds ||
+	    !(out=current->filp[out_fd]) || !(in=current->filp[in_fd]))
+		return -EBADF;
+	if (in->f_inode->i_pipe || !S_ISREG(in->f_inode->i_mode) ||
+	    !(in->f_mode&1))
+		return -EINVAL;
+	verify_area(range,2*sizeof (off_t));
+	offset = get_fs_long((unsigned long *) range);
+	count = get_fs_long((unsigned long *) range+1);
+	if (count<0)
+		return -EINVAL;
+	pos = (offset<0) ? in->f_pos : offset;
+	n = file_send(in->f_inode,&pos,out,count);
+	if (offset<0)
+		in->f_pos = pos;
+	else
+		put_fs_long(pos,(unsigned long *) range);
+	return n;
+}
+
+/*
+ * splice() moves up to 'count' bytes from in_fd to out_fd, one of which
+ * must be a pipe. From a pipe it doesn't wait once it has moved something.
+ */
+int sys_splice(unsigned int in_fd, unsigned int out_fd, int count)
+{
+	struct file * in, * out;
+
+	if (out_fd >= current->max_fds || in_fd >= current->max_fds ||
+	    !(out=current->filp[out_fd]) || !(in=current->filp[in_fd]))
+		return -EBADF;
+	if (count<0 || in->f_inode == out->f_inode ||
+	    !(in->f_inode->i_pipe || out->f_inode->i_pipe))
+		return -EINVAL;
+	if (!count)
+		return 0;
+	if (in->f_inode->i_pipe)
+		return (in->f_mode&1)?pipe_send(in->f_inode,out,count):-EIO;
+	if (!S_ISREG(in->f_inode->i_mode))
+		return -EINVAL;
+	return file_send(in->f_inode,&in->f_pos,out,count);
+}
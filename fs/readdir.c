@@ -0,0 +1,106 @@
+/*
+ *  linux/fs/readdir.c
+ */
+
+/*
+ * getdents() copies a whole bufferful of directory entries per call,
+ * straight out of the directory blocks, instead of one 16-byte entry per
+ * read(). getdents_plus() adds the mode, size and mtime of every entry,
+ * taken from the inode cache, so that "ls -l" needs no stat() per name.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+static int do_getdents(unsigned int fd, char * buf, unsigned int count,
+	int plus)
+{
+	union {
+		struct dirent d;
+		struct dirent_plus p;
+	} rec;
+	char name[NAME_LEN];
+	struct file * file;
+	struct m_inode * dir, * inode;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	int nameoff,written,reclen,len,ino,block,i;
+	off_t pos;
+
+	if (fd >= current->max_fds || !(file=current->filp[fd]) ||
+	    !(dir=file->f_inode))
+		return -EBADF;
+	if (!S_ISDIR(dir->i_mode))
+		return -ENOTDIR;
+	verify_area(buf,count);
+	nameoff = plus ? offsetof(struct dirent_plus,d_name) :
+		offsetof(struct dirent,d_name);
+	written = 0;
+	pos = (file->f_pos + sizeof (struct dir_entry)-1) &
+		~(sizeof (struct dir_entry)-1);
+	while (pos < dir->i_size) {
+		if (!(block = bmap(dir,pos/BLOCK_SIZE)) ||
+		    !(bh = bread(dir->i_dev,block))) {
+			pos += BLOCK_SIZE - pos%BLOCK_SIZE;
+			continue;
+		}
+		de = (struct dir_entry *) (bh->b_data + pos%BLOCK_SIZE);
+		for ( ; pos < dir->i_size && (char *) de < bh->b_data+BLOCK_SIZE ;
+		     de++, pos += sizeof (struct dir_entry)) {
+			if (!(ino = de->inode))
+				continue;
+			for (len=0 ; len<NAME_LEN && de->name[len] ; len++)
+				name[len] = de->name[len];
+			reclen = (nameoff + len + 1 + 3) & ~3;
+			if (reclen > count - written) {
+				brelse(bh);
+				goto out;
+			}
+			memset(&rec,0,sizeof (rec));
+			if (plus) {
+				rec.p.d_ino = ino;
+				rec.p.d_reclen = reclen;
+				rec.p.d_off = pos + sizeof (struct dir_entry);
+				if ((inode = iget(dir->i_dev,ino))) {
+					rec.p.d_size = inode->i_size;
+					rec.p.d_mtime = inode->i_mtime;
+					rec.p.d_mode = inode->i_mode;
+					iput(inode);
+				}
+			} else {
+				rec.d.d_ino = ino;
+				rec.d.d_reclen = reclen;
+				rec.d.d_off = pos + sizeof (struct dir_entry);
+			}
+			memcpy(nameoff + (char *) &rec,name,len);
+			for (i=0 ; i<reclen ; i++)
+				put_fs_byte(((char *) &rec)[i],buf+written+i);
+			written += reclen;
+		}
+		brelse(bh);
+	}
+out:
+	file->f_pos = pos;
+	dir->i_atime = CURRENT_TIME;
+	if (!written && pos < dir->i_size)
+		return -EINVAL;		/* buffer too small for one entry */
+	return written;
+}
+
+int sys_getdents(unsigned int fd, struct dirent * dirp, unsigned int count)
+{
+	return do_getdents(fd,(char *) dirp,count,0);
+}
+
+int sys_getdents_plus(unsigned int fd, struct dirent_plus * dirp,
+	unsigned int count)
+{
+	return do_getdents(fd,(char *) dirp,count,1);
+}
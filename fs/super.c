@@ -18,12 +18,6 @@
 int sync_dev(int dev);
 void wait_for_keypress(void);
 
-/* set_bit uses setb, as gas doesn't recognize setc */
-#define set_bit(bitnr,addr) ({ \
-register int __res ; \
-__asm__("bt %2,%3;setb %%al":"=a" (__res):"a" (0),"r" (bitnr),"m" (*(addr))); \
-__res; })
-
 struct super_block super_block[NR_SUPER];
 /* this is initialized in init/main.c */
 int ROOT_DEV = 0;
@@ -87,6 +81,8 @@ void put_super(int dev)
 		printk("Mounted disk changed - tssk, tssk\n\r");
 		return;
 	}
+	if (IS_TMP(dev))
+		tmp_put_super(sb);
 	lock_super(sb);
 	sb->s_dev = 0;
 	for(i=0;i<I_MAP_SLOTS;i++)
@@ -97,10 +93,12 @@ void put_super(int dev)
 	return;
 }
 
-static struct super_block * read_super(int dev)
+/* 'flag' is the mount flag: tmpfs takes its size limit from it */
+static struct super_block * read_super(int dev, int flag)
 {
 	struct super_block * s;
 	struct buffer_head * bh;
+	struct d_super_block * d;
 	int i,block;
 
 	if (!dev)
@@ -121,23 +119,53 @@ static struct super_block * read_super(int dev)
 	s->s_rd_only = 0;
 	s->s_dirt = 0;
 	lock_super(s);
+	if (IS_TMP(dev)) {
+		if (tmp_read_super(s,TMP_PAGES(flag))) {
+			s->s_dev = 0;
+			free_super(s);
+			return NULL;
+		}
+		free_super(s);
+		return s;
+	}
 	if (!(bh = bread(dev,1))) {
 		s->s_dev=0;
 		free_super(s);
 		return NULL;
 	}
-	*((struct d_super_block *) s) =
-		*((struct d_super_block *) bh->b_data);
+	for (i=0;i<I_MAP_SLOTS;i++)
+		s->s_imap[i] = NULL;
+	for (i=0;i<Z_MAP_SLOTS;i++)
+		s->s_zmap[i] = NULL;
+	s->s_dalloc = 0;
+	d = (struct d_super_block *) bh->b_data;
+	if (d->s_magic == GRP_MAGIC) {
+		block = grp_read_super(s,bh);
+		brelse(bh);
+		if (block) {
+			for(i=0;i<Z_MAP_SLOTS;i++)
+				brelse(s->s_zmap[i]);
+			s->s_dev = 0;
+			free_super(s);
+			return NULL;
+		}
+		free_super(s);
+		return s;
+	}
+	s->s_ninodes = d->s_ninodes;
+	s->s_nzones = d->s_nzones;
+	s->s_imap_blocks = d->s_imap_blocks;
+	s->s_zmap_blocks = d->s_zmap_blocks;
+	s->s_firstdatazone = d->s_firstdatazone;
+	s->s_log_zone_size = d->s_log_zone_size;
+	s->s_max_size = d->s_max_size;
+	s->s_magic = d->s_magic;
 	brelse(bh);
 	if (s->s_magic != SUPER_MAGIC) {
 		s->s_dev = 0;
 		free_super(s);
 		return NULL;
 	}
-	for (i=0;i<I_MAP_SLOTS;i++)
-		s->s_imap[i] = NULL;
-	for (i=0;i<Z_MAP_SLOTS;i++)
-		s->s_zmap[i] = NULL;
 	block=2;
 	for (i=0 ; i < s->s_imap_blocks ; i++)
 		if ((s->s_imap[i]=bread(dev,block)))
@@ -160,6 +188,8 @@ static struct super_block * read_super(int dev)
 	}
 	s->s_imap[0]->b_data[0] |= 1;
 	s->s_zmap[0]->b_data[0] |= 1;
+	s->s_free_inodes = count_free(s->s_imap,s->s_ninodes+1);
+	s->s_free_zones = count_free(s->s_zmap,s->s_nzones-s->s_firstdatazone+1);
 	free_super(s);
 	return s;
 }
@@ -184,9 +214,13 @@ int sys_umount(char * dev_name)
 		return -ENOENT;
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
+	sync_truncate(dev);
 	for (inode=inode_table+0 ; inode<inode_table+NR_INODE ; inode++)
 		if (inode->i_dev==dev && inode->i_count)
 				return -EBUSY;
+	sync_dalloc(dev);
+	sync_inodes();		/* iput() leaves dirty inodes to us */
+	notify_umount(dev);
 	sb->s_imount->i_mount=0;
 	iput(sb->s_imount);
 	sb->s_imount = NULL;
@@ -221,7 +255,7 @@ int sys_mount(char * dev_name, char * dir_name, int rw_flag)
 		iput(dir_i);
 		return -EPERM;
 	}
-	if (!(sb=read_super(dev))) {
+	if (!(sb=read_super(dev,rw_flag))) {
 		iput(dir_i);
 		return -EBUSY;
 	}
@@ -241,15 +275,13 @@ int sys_mount(char * dev_name, char * dir_name, int rw_flag)
 
 void mount_root(void)
 {
-	int i,free;
 	struct super_block * p;
 	struct m_inode * mi;
 
-	if (32 != sizeof (struct d_inode))
+	if (32 != sizeof (struct d_inode) || 64 != sizeof (struct g_inode))
 		panic("bad i-node size");
-	for(i=0;i<NR_FILE;i++)
-		file_table[i].f_count=0;
-	if (MAJOR(ROOT_DEV) == 2) {
+	if (MAJOR(ROOT_DEV) == 2 ||
+	    (IS_CFS(ROOT_DEV) && MAJOR(CFS_DEV(ROOT_DEV)) == 2)) {
 		printk("Insert root floppy and press ENTER");
 		wait_for_keypress();
 	}
@@ -258,7 +290,7 @@ void mount_root(void)
 		p->s_lock = 0;
 		p->s_wait = NULL;
 	}
-	if (!(p=read_super(ROOT_DEV)))
+	if (!(p=read_super(ROOT_DEV,0)))
 		panic("Unable to mount root");
 	if (!(mi=iget(ROOT_DEV,ROOT_INO)))
 		panic("Unable to read root i-node");
@@ -266,16 +298,7 @@ void mount_root(void)
 	p->s_isup = p->s_imount = mi;
 	current->pwd = mi;
 	current->root = mi;
-	free=0;
-	i=p->s_nzones;
-	while (-- i >= 0)
-		if (!set_bit(i&8191,p->s_zmap[i>>13]->b_data))
-			free++;
-	printk("%d/%d free blocks\n\r",free,p->s_nzones);
-	free=0;
-	i=p->s_ninodes+1;
-	while (-- i >= 0)
-		if (!set_bit(i&8191,p->s_imap[i>>13]->b_data))
-			free++;
-	printk("%d/%d free inodes\n\r",free,p->s_ninodes);
+	printk("%d/%d free blocks\n\r",p->s_free_zones<<p->s_log_zone_size,
+		p->s_nzones<<p->s_log_zone_size);
+	printk("%d/%d free inodes\n\r",p->s_free_inodes,p->s_ninodes);
 }
@@ -0,0 +1,142 @@
+/*
+ *  linux/fs/tmpfs.c
+ */
+
+/*
+ * tmpfs is a minix-like filesystem that only lives in memory. A zone is
+ * a page from get_free_page(), and zone z is the page at address z<<12,
+ * so block b is the kilobyte at b<<10: getblk() hands out buffer heads
+ * that point right at it, and nothing is ever read or written. The
+ * inodes are kept in a page of the super-block. There are no bitmaps:
+ * the super-block just counts the free pages against the size limit,
+ * and freed zones go straight back to the page allocator.
+ *
+ * A tmpfs is mounted from a block special file with major TMP_MAJOR,
+ * the minor telling the instances apart.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+#define TMP_ZONE_BITS 12	/* a zone is a page */
+#define TMP_DEF_PAGES 256	/* default size limit: 1MB */
+
+extern void invalidate_inodes(int dev);
+
+int tmp_new_block(struct super_block * sb)
+{
+	unsigned long page;
+
+	if (!sb->s_free_zones || !(page = get_free_page()))
+		return 0;
+	sb->s_free_zones--;
+	return page >> TMP_ZONE_BITS;
+}
+
+void tmp_free_block(struct super_block * sb, int zone)
+{
+	tmp_wait_page(zone << TMP_ZONE_BITS);
+	free_page(zone << TMP_ZONE_BITS);
+	sb->s_free_zones++;
+}
+
+/*
+ * An inode is in use when it has a mode or links. A new one gets a link
+ * right away, so that it isn't handed out again before it's first written.
+ */
+int tmp_new_inode(struct super_block * sb)
+{
+	struct d_inode * p;
+	int nr;
+
+	for (nr=1 ; nr <= sb->s_ninodes ; nr++) {
+		p = sb->s_itable + nr;
+		if (!p->i_mode && !p->i_nlinks) {
+			p->i_nlinks = 1;
+			return nr;
+		}
+	}
+	return 0;
+}
+
+void tmp_free_inode(struct super_block * sb, int nr)
+{
+	memset(sb->s_itable+nr,0,sizeof (struct d_inode));
+}
+
+/* set up a new, empty tmpfs of at most 'pages' pages in 'sb' */
+int tmp_read_super(struct super_block * sb, int pages)
+{
+	struct d_inode * root;
+	struct dir_entry * de;
+	unsigned long page;
+	int i,zone;
+
+	if (pages <= 0 || pages > 0xffff)
+		pages = TMP_DEF_PAGES;
+	if (!(page = get_free_page()))
+		return -1;
+	sb->s_itable = (struct d_inode *) page;
+	sb->s_ninodes = PAGE_SIZE/sizeof (struct d_inode) - 1;
+	sb->s_nzones = pages;
+	sb->s_imap_blocks = sb->s_zmap_blocks = 0;
+	sb->s_firstdatazone = 0;
+	sb->s_log_zone_size = TMP_ZONE_BITS - BLOCK_SIZE_BITS;
+	sb->s_max_size = pages * PAGE_SIZE;
+	sb->s_magic = TMP_MAGIC;
+	for (i=0 ; i<I_MAP_SLOTS ; i++)
+		sb->s_imap[i] = NULL;
+	for (i=0 ; i<Z_MAP_SLOTS ; i++)
+		sb->s_zmap[i] = NULL;
+	sb->s_free_inodes = sb->s_ninodes - 1;
+	sb->s_free_zones = pages;
+	sb->s_dalloc = 0;
+	if (!(zone = tmp_new_block(sb))) {
+		free_page(page);
+		sb->s_itable = NULL;
+		return -1;
+	}
+	de = (struct dir_entry *) (zone << TMP_ZONE_BITS);
+	de[0].inode = de[1].inode = ROOT_INO;
+	strcpy(de[0].name,".");
+	strcpy(de[1].name,"..");
+	root = sb->s_itable + ROOT_INO;
+	root->i_mode = S_IFDIR | 0777;
+	root->i_uid = current->euid;
+	root->i_gid = current->egid;
+	root->i_size = 2 * sizeof (struct dir_entry);
+	root->i_time = CURRENT_TIME;
+	root->i_nlinks = 2;
+	root->i_zone[0] = zone;
+	return 0;
+}
+
+/*
+ * Called at umount, when no inode is in use any more: all the pages of
+ * all the files go back to the page allocator, and the cached inodes are
+ * forgotten, as their zones don't exist any more.
+ */
+void tmp_put_super(struct super_block * sb)
+{
+	struct m_inode tmp;
+	int nr;
+
+	if (!sb->s_itable)
+		return;
+	for (nr=1 ; nr <= sb->s_ninodes ; nr++) {
+		if (!sb->s_itable[nr].i_mode && !sb->s_itable[nr].i_nlinks)
+			continue;
+		memset(&tmp,0,sizeof (tmp));
+		unpack_inode(&tmp,sb->s_itable+nr);
+		tmp.i_dev = sb->s_dev;
+		tmp.i_num = nr;
+		truncate(&tmp);
+	}
+	invalidate_inodes(sb->s_dev);
+	free_page((unsigned long) sb->s_itable);
+	sb->s_itable = NULL;
+}
@@ -4,62 +4,248 @@
  *  (C) 1991  Linus Torvalds
  */
 
+#include <errno.h>
+
+#include <linux/config.h>
 #include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
 
 #include <sys/stat.h>
 
-static void free_ind(int dev,int block)
+/*
+ * The zones of a file are collected in a page and freed a pageful at a
+ * time by free_blocks(), sorted, so that neighbouring zones are cleared
+ * in the zone map a word at a time. If there's no page to spare, they
+ * are freed one by one as they come.
+ */
+#define NR_BATCH (PAGE_SIZE/sizeof (unsigned long))
+
+struct batch {
+	struct super_block * sb;
+	int dev;
+	int nr;
+	unsigned long * zone;
+};
+
+static void flush_batch(struct batch * b)
+{
+	unsigned long * z = b->zone, tmp;
+	int gap,i,j;
+
+	if (!b->nr)
+		return;
+	for (gap = 1 ; gap < b->nr/3 ; gap = 3*gap+1)
+		/* nothing */ ;
+	for ( ; gap > 0 ; gap /= 3)
+		for (i=gap ; i < b->nr ; i++) {
+			tmp = z[i];
+			for (j=i ; j >= gap && z[j-gap] > tmp ; j -= gap)
+				z[j] = z[j-gap];
+			z[j] = tmp;
+		}
+	free_blocks(b->dev,z,b->nr);
+	b->nr = 0;
+}
+
+static void add_zone(struct batch * b, int zone)
+{
+	if (!zone)
+		return;
+	if (!b->zone) {
+		free_block(b->dev,zone);
+		return;
+	}
+	if (b->nr >= NR_BATCH)
+		flush_batch(b);
+	b->zone[b->nr++] = zone;
+}
+
+/* start reading indirect zone 'zone', without waiting */
+static void read_ahead(struct batch * b, int zone)
+{
+	struct buffer_head * bh;
+
+	if (IS_TMP(b->dev))
+		return;
+	if (zone && (bh = getblk(b->dev,zone<<b->sb->s_log_zone_size))) {
+		if (!bh->b_uptodate)
+			ll_rw_block(READA,bh);
+		bh->b_count--;
+	}
+}
+
+/* indirect zones hold zone numbers, in their first block */
+static void free_ind(struct batch * b,int block)
 {
 	struct buffer_head * bh;
-	unsigned short * p;
 	int i;
 
 	if (!block)
 		return;
-	if ((bh=bread(dev,block))) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_block(dev,*p);
+	if ((bh=bread(b->dev,block<<b->sb->s_log_zone_size))) {
+		for (i=0 ; i<IND_ZONES(b->sb) ; i++)
+			add_zone(b,ind_zone(b->sb,bh->b_data,i));
 		brelse(bh);
 	}
-	free_block(dev,block);
+	add_zone(b,block);
 }
 
-static void free_dind(int dev,int block)
+static void free_dind(struct batch * b,int block)
 {
 	struct buffer_head * bh;
-	unsigned short * p;
 	int i;
 
 	if (!block)
 		return;
-	if ((bh=bread(dev,block))) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_ind(dev,*p);
+	if ((bh=bread(b->dev,block<<b->sb->s_log_zone_size))) {
+		for (i=0 ; i<IND_ZONES(b->sb) ; i++)
+			read_ahead(b,ind_zone(b->sb,bh->b_data,i));
+		for (i=0 ; i<IND_ZONES(b->sb) ; i++)
+			free_ind(b,ind_zone(b->sb,bh->b_data,i));
 		brelse(bh);
 	}
-	free_block(dev,block);
+	add_zone(b,block);
 }
 
-void truncate(struct m_inode * inode)
+static void do_truncate(struct m_inode * inode)
 {
+	struct batch b;
 	int i;
 
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
-	for (i=0;i<7;i++)
-		if (inode->i_zone[i]) {
-			free_block(inode->i_dev,inode->i_zone[i]);
-			inode->i_zone[i]=0;
-		}
-	free_ind(inode->i_dev,inode->i_zone[7]);
-	free_dind(inode->i_dev,inode->i_zone[8]);
+	drop_dalloc(inode);
+	if (!(b.sb = get_super(inode->i_dev)))
+		panic("truncate: no super-block");
+	b.dev = inode->i_dev;
+	b.nr = 0;
+	b.zone = (unsigned long *) get_free_page();
+	read_ahead(&b,inode->i_zone[7]);
+	read_ahead(&b,inode->i_zone[8]);
+	for (i=0;i<7;i++) {
+		add_zone(&b,inode->i_zone[i]);
+		inode->i_zone[i]=0;
+	}
+	free_ind(&b,inode->i_zone[7]);
+	free_dind(&b,inode->i_zone[8]);
 	inode->i_zone[7] = inode->i_zone[8] = 0;
+	if (b.zone) {
+		flush_batch(&b);
+		free_page((unsigned long) b.zone);
+	}
 	inode->i_size = 0;
-	inode->i_dirt = 1;
+	inode->i_dirt = inode->i_ddirt = 1;
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 }
 
+/* truncate() counts as a write for defrag() */
+void truncate(struct m_inode * inode)
+{
+	inode->i_writers++;
+	inode->i_version++;
+	do_truncate(inode);
+	inode->i_version++;
+	inode->i_writers--;
+}
+
+#ifdef DEFER_TRUNCATE
+#define NR_DEFER 4
+
+/*
+ * Freeing the zones of a big unlinked file takes a while, so iput() can
+ * leave it to the truncd task (started by init), which just waits in
+ * sys_truncd() for work. The inode stays in the table, with the count
+ * iput() would have dropped, until it's done. Only a few are queued, as
+ * inodes are scarce: if the queue is full, iput() does it right away.
+ */
+static struct m_inode * defer[NR_DEFER];
+static struct task_struct * truncd_wait = NULL;
+static struct m_inode * truncd_inode = NULL;	/* the one being done */
+static struct task_struct * truncd_done = NULL;
+static int truncd_running = 0;
+
+int defer_truncate(struct m_inode * inode)
+{
+	int i;
+
+	if (!truncd_running || inode->i_size < DEFER_TRUNCATE*1024 ||
+	    !(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
+		return 0;
+	for (i=0 ; i<NR_DEFER ; i++)
+		if (!defer[i]) {
+			defer[i] = inode;
+			wake_up(&truncd_wait);
+			return 1;
+		}
+	return 0;
+}
+
+static void do_defer(struct m_inode * inode)
+{
+	do_truncate(inode);
+	free_inode(inode);
+}
+
+/*
+ * umount can't wait for truncd to get to the queued inodes of 'dev', so
+ * they are done now. One that truncd has already taken is still in use,
+ * though, so we wait for that one.
+ */
+void sync_truncate(int dev)
+{
+	struct m_inode * inode;
+	int i;
+
+repeat:
+	for (i=0 ; i<NR_DEFER ; i++)
+		if ((inode = defer[i]) && inode->i_dev == dev) {
+			defer[i] = NULL;
+			do_defer(inode);
+		}
+	if (truncd_inode && truncd_inode->i_dev == dev) {
+		sleep_on(&truncd_done);
+		goto repeat;
+	}
+}
+
+int sys_truncd(void)
+{
+	struct m_inode * inode;
+	int i;
+
+	if (!suser())
+		return -EPERM;
+	if (truncd_running)
+		return -EBUSY;
+	truncd_running = 1;
+	for (;;) {
+		for (i=0 ; i<NR_DEFER ; i++)
+			if ((inode = defer[i])) {
+				defer[i] = NULL;
+				truncd_inode = inode;
+				do_defer(inode);
+				truncd_inode = NULL;
+				wake_up(&truncd_done);
+			}
+		for (i=0 ; i<NR_DEFER && !defer[i] ; i++)
+			/* nothing */ ;
+		if (i >= NR_DEFER)
+			sleep_on(&truncd_wait);
+	}
+}
+#else
+int defer_truncate(struct m_inode * inode)
+{
+	return 0;
+}
+
+void sync_truncate(int dev)
+{
+}
+
+int sys_truncd(void)
+{
+	return -ENOSYS;
+}
+#endif
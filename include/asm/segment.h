@@ -37,6 +37,79 @@ static inline void put_fs_long(unsigned long val,unsigned long * addr)
 __asm__ ("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/* zero 'count' bytes at fs:addr, a long at a time once it's aligned */
+static inline void clear_fs(char * addr, int count)
+{
+	int d0,d1;
+
+	for ( ; count > 0 && ((long) addr & 3) ; count--)
+		put_fs_byte(0,addr++);
+	if (count <= 0)
+		return;
+	if (count >= 4)
+		__asm__ __volatile__("push %%es\n\t"
+			"push %%fs\n\t"
+			"pop %%es\n\t"
+			"cld\n\t"
+			"rep ; stosl\n\t"
+			"pop %%es"
+			:"=&c" (d0),"=&D" (d1)
+			:"a" (0),"0" (count>>2),"1" (addr)
+			:"memory");
+	addr += count & ~3;
+	for (count &= 3 ; count ; count--)
+		put_fs_byte(0,addr++);
+}
+
+/*
+ * Copy n bytes to fs:to / from fs:from. Bytes are moved one at a time
+ * until the user address is aligned, then a long at a time, then the
+ * tail. The caller does verify_area() on the whole range first.
+ */
+static inline void memcpy_tofs(char * to, const char * from, int n)
+{
+	int d0,d1,d2,head;
+
+	if (n <= 0)
+		return;
+	if ((head = -(long) to & 3) > n)
+		head = n;
+	n -= head;
+	__asm__ __volatile__("push %%es\n\t"
+		"push %%fs\n\t"
+		"pop %%es\n\t"
+		"cld\n\t"
+		"rep ; movsb\n\t"
+		"movl %3,%%ecx\n\t"
+		"rep ; movsl\n\t"
+		"movl %4,%%ecx\n\t"
+		"rep ; movsb\n\t"
+		"pop %%es"
+		:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+		:"r" (n>>2),"r" (n&3),"0" (head),"1" (to),"2" (from)
+		:"memory");
+}
+
+static inline void memcpy_fromfs(char * to, const char * from, int n)
+{
+	int d0,d1,d2,head;
+
+	if (n <= 0)
+		return;
+	if ((head = -(long) from & 3) > n)
+		head = n;
+	n -= head;
+	__asm__ __volatile__("cld\n\t"
+		"rep ; fs ; movsb\n\t"
+		"movl %3,%%ecx\n\t"
+		"rep ; fs ; movsl\n\t"
+		"movl %4,%%ecx\n\t"
+		"rep ; fs ; movsb"
+		:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+		:"r" (n>>2),"r" (n&3),"0" (head),"1" (to),"2" (from)
+		:"memory");
+}
+
 /*
  * Someone who knows GNU asm better than I should double check the followig.
  * It seems to work, but I don't know if I'm doing something subtly wrong.
@@ -0,0 +1,35 @@
+#ifndef _DIRENT_H
+#define _DIRENT_H
+
+#include <sys/types.h>
+
+#define MAXNAMLEN 14
+
+/*
+ * getdents() packs as many of these as fit into the buffer. d_reclen is
+ * the size of the record (a multiple of 4), and d_off the directory
+ * offset to seek to for the entry after this one.
+ */
+struct dirent {
+	ino_t d_ino;
+	unsigned short d_reclen;
+	off_t d_off;
+	char d_name[MAXNAMLEN+1];
+};
+
+/* getdents_plus() also returns the most wanted parts of the inode */
+struct dirent_plus {
+	ino_t d_ino;
+	unsigned short d_reclen;
+	off_t d_off;
+	off_t d_size;
+	time_t d_mtime;
+	mode_t d_mode;
+	char d_name[MAXNAMLEN+1];
+};
+
+extern int getdents(int fildes, struct dirent * dirp, unsigned int count);
+extern int getdents_plus(int fildes, struct dirent_plus * dirp,
+	unsigned int count);
+
+#endif
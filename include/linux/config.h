@@ -45,4 +45,19 @@
  leave HD_TYPE undefined. This is the normal thing to do.
 */
 
+/*
+ * Define INODE_FILL to have read_inode() copy all the in-use inodes of
+ * the inode block it has just read into unused slots of the inode table,
+ * so that "ls -l" and friends find the rest of a directory in memory.
+ * It pushes out other cached inodes, so it's off by default.
+ */
+/*#define INODE_FILL */
+
+/*
+ * Define DEFER_TRUNCATE to a size in kilobytes to have the blocks of
+ * unlinked files at least that big freed by the truncd task that init
+ * starts, instead of by the process doing the last iput().
+ */
+/*#define DEFER_TRUNCATE 1024 */
+
 #endif
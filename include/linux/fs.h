@@ -19,9 +19,22 @@
  * 5 - /dev/tty
  * 6 - /dev/lp
  * 7 - unnamed pipes
+ * 8 - tmpfs (no driver: the data is in memory, see fs/tmpfs.c)
+ * 9 - compressed images (no driver: see fs/cfs.c)
  */
 
-#define IS_SEEKABLE(x) ((x)>=1 && (x)<=3)
+#define TMP_MAJOR 8
+#define IS_TMP(dev) (MAJOR(dev)==TMP_MAJOR)
+/* the size limit of a tmpfs, in pages, is in the top of the mount flag */
+#define TMP_PAGES(flag) (((unsigned)(flag))>>16)
+
+#define CFS_MAJOR 9
+#define IS_CFS(dev) (MAJOR(dev)==CFS_MAJOR)
+/* bits 7-5 and 4-0 of the minor: major and minor of the image device */
+#define CFS_DEV(dev) (((((dev)>>5)&7)<<8) | ((dev)&31))
+
+/* files on tmpfs and cfs are seekable as well as those on real disks */
+#define IS_SEEKABLE(x) (((x)>=1 && (x)<=3) || (x)==TMP_MAJOR || (x)==CFS_MAJOR)
 
 #define READ 0
 #define WRITE 1
@@ -34,17 +47,27 @@ void buffer_init(long buffer_end);
 #define MINOR(a) ((a)&0xff)
 
 #define NAME_LEN 14
+
+/* for permission() */
+#define MAY_EXEC 1
+#define MAY_WRITE 2
+#define MAY_READ 4
 #define ROOT_INO 1
 
 #define I_MAP_SLOTS 8
 #define Z_MAP_SLOTS 8
 #define SUPER_MAGIC 0x137F
+#define GRP_MAGIC 0x4752	/* "GR" */
+#define TMP_MAGIC 0x1994
+#define CFS_MAGIC 0x31534643	/* "CFS1" */
 
-#define NR_OPEN 20
+#define NR_OPEN 3840	/* max fds per process, see fs/file_table.c */
+#define NR_OPEN_DEF 32	/* fds that fit in the task struct */
 #define NR_INODE 32
-#define NR_FILE 64
+#define NR_FILE 8192	/* max open files, in pages of FILES_PER_PAGE */
 #define NR_SUPER 8
 #define NR_HASH 307
+#define NR_MULTI 16	/* max blocks in one bread_multi() */
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
@@ -53,18 +76,44 @@ void buffer_init(long buffer_end);
 #endif
 
 #define INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct d_inode)))
+#define GRP_INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct g_inode)))
 #define DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct dir_entry)))
 
+/*
+ * A pipe is a ring of PIPE_BUF_SIZE bytes (a power of two) in contiguous
+ * pages at i_size, see fs/pipe.c. A sleeping reader is woken once there
+ * are PIPE_RWANT bytes or PIPE_HIWAT, a sleeping writer once there is
+ * room for PIPE_WWANT bytes or the data is down to PIPE_LOWAT.
+ */
+#define PIPE_DEF_SIZE 65536
+#define PIPE_MAX_SIZE 131072
 #define PIPE_HEAD(inode) ((inode).i_zone[0])
 #define PIPE_TAIL(inode) ((inode).i_zone[1])
-#define PIPE_SIZE(inode) ((PIPE_HEAD(inode)-PIPE_TAIL(inode))&(PAGE_SIZE-1))
+#define PIPE_BUF_SIZE(inode) ((inode).i_zone[2])
+#define PIPE_RWANT(inode) ((inode).i_zone[3])
+#define PIPE_WWANT(inode) ((inode).i_zone[4])
+#define PIPE_BUSY(inode) ((inode).i_zone[5])	/* copies going on */
+#define PIPE_RLOCK(inode) ((inode).i_zone[6])	/* see pipe_lock() */
+#define PIPE_WLOCK(inode) ((inode).i_zone[7])
+#define PIPE_SIZE(inode) \
+	((PIPE_HEAD(inode)-PIPE_TAIL(inode))&(PIPE_BUF_SIZE(inode)-1))
+#define PIPE_ROOM(inode) (PIPE_BUF_SIZE(inode)-1-PIPE_SIZE(inode))
 #define PIPE_EMPTY(inode) (PIPE_HEAD(inode)==PIPE_TAIL(inode))
-#define PIPE_FULL(inode) (PIPE_SIZE(inode)==(PAGE_SIZE-1))
-#define INC_PIPE(head) \
-__asm__("incl %0\n\tandl $4095,%0"::"m" (head))
+#define PIPE_FULL(inode) (!PIPE_ROOM(inode))
+#define PIPE_HIWAT(inode) (PIPE_BUF_SIZE(inode)/2)
+#define PIPE_LOWAT(inode) (PIPE_BUF_SIZE(inode)/4)
 
 typedef char buffer_block[BLOCK_SIZE];
 
+/*
+ * A delalloc (delayed allocation) buffer holds data written to a hole or
+ * past the end of a regular file. It has no disk block yet: b_blocknr is
+ * the logical block in b_inode, and a zone is only reserved in the super-
+ * block. flush_dalloc() gives such buffers real blocks, in contiguous runs,
+ * when the file is synced or its inode is reused. find_buffer() never
+ * returns them.
+ */
+
 struct buffer_head {
 	char * b_data;			/* pointer to data block (1024 bytes) */
 	unsigned long b_blocknr;	/* block number */
@@ -73,7 +122,9 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
+	unsigned char b_dalloc;		/* 1 - no disk block yet, see below */
 	struct task_struct * b_wait;
+	struct m_inode * b_inode;	/* owner of a delalloc buffer */
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
@@ -97,7 +148,7 @@ struct m_inode {
 	unsigned long i_mtime;
 	unsigned char i_gid;
 	unsigned char i_nlinks;
-	unsigned short i_zone[9];
+	unsigned long i_zone[9];	/* 16 bits on the disk, on minix */
 /* these are in memory also */
 	struct task_struct * i_wait;
 	unsigned long i_atime;
@@ -108,9 +159,17 @@ struct m_inode {
 	unsigned char i_lock;
 	unsigned char i_dirt;
 	unsigned char i_pipe;
+	unsigned char i_notify;		/* an inotify queue (see notify.c) */
 	unsigned char i_mount;
 	unsigned char i_seek;
 	unsigned char i_update;
+	unsigned char i_dflush;		/* flush_dalloc() is running */
+	unsigned char i_ddirt;		/* size or zones changed (fdatasync) */
+	unsigned short i_dalloc;	/* nr of delalloc buffers */
+	unsigned short i_version;	/* bumped by writes, see defrag() */
+	unsigned short i_writers;	/* writes and truncates going on */
+	unsigned short i_readers[2];	/* reads going on, by generation */
+	unsigned char i_rgen;		/* generation new reads count in */
 };
 
 struct file {
@@ -119,11 +178,14 @@ struct file {
 	unsigned short f_count;
 	struct m_inode * f_inode;
 	off_t f_pos;
+	struct file * f_next;		/* free list */
 };
 
+#define FILES_PER_PAGE (4096/sizeof (struct file))
+
 struct super_block {
 	unsigned short s_ninodes;
-	unsigned short s_nzones;
+	unsigned long s_nzones;
 	unsigned short s_imap_blocks;
 	unsigned short s_zmap_blocks;
 	unsigned short s_firstdatazone;
@@ -141,6 +203,12 @@ struct super_block {
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt;
+	unsigned long s_free_zones;	/* kept up to date by bitmap.c */
+	unsigned long s_free_inodes;
+	unsigned long s_dalloc;		/* zones reserved for delalloc buffers */
+	struct d_inode * s_itable;	/* tmpfs: the inodes, in one page */
+	unsigned short s_ngroups;	/* group fs: the group descriptors */
+	unsigned short s_ipg;		/* are in s_zmap[] */
 };
 
 struct d_super_block {
@@ -154,13 +222,110 @@ struct d_super_block {
 	unsigned short s_magic;
 };
 
+/*
+ * A group filesystem is cut in groups of GRP_ZONES zones, each starting
+ * with its own zone-map block, inode-map block and inode table, so that
+ * the inodes are near their data. Group g holds zones g*GRP_ZONES on,
+ * and inodes g*s_ipg+1 on; the zones that aren't free for data (the boot
+ * and super-blocks, the descriptors and the maps and inode tables) are
+ * just marked busy. Zone numbers are 32 bits, in the inodes and in the
+ * indirect blocks both. Inode numbers are still 16 bits, as directories
+ * are the same as on minix. The super-block is in block 1, with the magic
+ * where minix has it, and the group descriptors follow it.
+ */
+#define GRP_ZONES 8192		/* a zone-map block */
+#define GRP_DESC_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct grp_desc)))
+#define IS_GRP(sb) ((sb)->s_magic == GRP_MAGIC)
+/* the block of the inode table that holds inode 'nr' */
+#define inode_block(sb,nr) (IS_GRP(sb) ? grp_inode_block(sb,nr) : \
+	2 + (sb)->s_imap_blocks + (sb)->s_zmap_blocks + ((nr)-1)/INODES_PER_BLOCK)
+
+struct g_inode {
+	unsigned short i_mode;
+	unsigned short i_uid;
+	unsigned long i_size;
+	unsigned long i_time;
+	unsigned char i_gid;
+	unsigned char i_nlinks;
+	unsigned short i_pad;
+	unsigned long i_zone[9];
+	unsigned long i_spare[3];
+};
+
+struct d_grp_super_block {
+	unsigned short s_ninodes;
+	unsigned short s_ngroups;
+	unsigned long s_nzones;
+	unsigned short s_ipg;		/* inodes per group */
+	unsigned short s_log_zone_size;
+	unsigned long s_max_size;
+	unsigned short s_magic;
+};
+
+struct grp_desc {
+	unsigned long g_zmap;		/* block numbers */
+	unsigned long g_imap;
+	unsigned long g_itable;
+	unsigned short g_free_zones;
+	unsigned short g_free_inodes;
+};
+
+#define group_desc(sb,g) ((struct grp_desc *) (sb)->s_zmap[(g)/ \
+	GRP_DESC_PER_BLOCK]->b_data + (g)%GRP_DESC_PER_BLOCK)
+#define group_desc_dirt(sb,g) ((sb)->s_zmap[(g)/GRP_DESC_PER_BLOCK]->b_dirt = 1)
+
+/*
+ * Indirect blocks hold 16-bit zone numbers on minix and tmpfs, and 32-bit
+ * ones on a group filesystem, where they map only 256 zones each.
+ */
+#define IND_BITS(sb) (IS_GRP(sb) ? 8 : 9)
+#define IND_ZONES(sb) (1<<IND_BITS(sb))
+#define MAX_ZONES(sb) (7+IND_ZONES(sb)+IND_ZONES(sb)*IND_ZONES(sb))
+#define ind_zone(sb,data,i) (IS_GRP(sb) ? ((unsigned long *) (data))[i] : \
+	((unsigned short *) (data))[i])
+#define set_ind_zone(sb,data,i,zone) do { \
+	if (IS_GRP(sb)) ((unsigned long *) (data))[i] = (zone); \
+	else ((unsigned short *) (data))[i] = (zone); } while (0)
+
+/*
+ * A compressed image starts with this header, in block 0. Block 1 on
+ * holds h_chunks+1 byte offsets: chunk n (CFS_CHUNK blocks of the minix
+ * image) is stored between offsets n and n+1, see fs/cfs.c.
+ */
+#define CFS_CHUNK_BITS 2
+#define CFS_CHUNK (BLOCK_SIZE<<CFS_CHUNK_BITS)
+
+struct cfs_header {
+	unsigned long h_magic;
+	unsigned long h_chunks;
+	unsigned long h_size;		/* of the whole image, in bytes */
+};
+
 struct dir_entry {
 	unsigned short inode;
 	char name[NAME_LEN];
 };
 
+/*
+ * A hashed directory keeps this header in the third slot of its first
+ * block (after "." and ".."). It has inode 0, so to older kernels it is
+ * just a free entry: the first name they add overwrites it, and the
+ * directory silently turns back into a plain linear one. All the other
+ * entries live in block 1+(hash%buckets), or in the blocks after that
+ * one if it is full. tools/dirhash builds the index.
+ */
+#define DIR_HASH_MAGIC 0x4844
+
+struct dir_hash {
+	unsigned short inode;		/* always 0 */
+	char zero;			/* always 0: no name starts with NUL */
+	char version;
+	unsigned short magic;
+	unsigned short buckets;
+	char pad[NAME_LEN-6];
+};
+
 extern struct m_inode inode_table[NR_INODE];
-extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
@@ -171,10 +336,16 @@ extern int ticks_to_floppy_on(unsigned int dev);
 extern void floppy_on(unsigned int dev);
 extern void floppy_off(unsigned int dev);
 extern void truncate(struct m_inode * inode);
+extern int defer_truncate(struct m_inode * inode);
+extern void sync_truncate(int dev);
 extern void sync_inodes(void);
+extern int sync_inode(struct m_inode * inode);
 extern void wait_on(struct m_inode * inode);
 extern int bmap(struct m_inode * inode,int block);
 extern int create_block(struct m_inode * inode,int block);
+extern int map_block(struct m_inode * inode,int block,int zone);
+extern int find_zone(struct m_inode * inode,int zone,int last,int data);
+extern int permission(struct m_inode * inode,int mask);
 extern struct m_inode * namei(const char * pathname);
 extern int open_namei(const char * pathname, int flag, int mode,
 	struct m_inode ** res_inode);
@@ -182,18 +353,57 @@ extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
 extern struct m_inode * get_pipe_inode(void);
+extern void pipe_wake(struct m_inode * inode);
+extern void pipe_wait(struct m_inode * inode, int rw, int want);
+extern void pipe_lock(struct m_inode * inode, int rw);
+extern void pipe_unlock(struct m_inode * inode, int rw);
+extern int pipe_resize(struct m_inode * inode, unsigned long size);
+extern struct file * get_empty_filp(void);
+extern void put_filp(struct file * f);
+extern int get_unused_fd(unsigned int start);
+extern void put_unused_fd(unsigned int fd);
+extern void notify(struct m_inode * inode, unsigned long mask,
+	const char * name, int len);
+extern void notify_free(struct m_inode * inode);
+extern void notify_release(struct m_inode * inode);
+extern void notify_umount(int dev);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
+extern void ll_rw_sectors(int rw, struct buffer_head * bh, int nr);
+extern void cfs_rw_block(int rw, struct buffer_head * bh);
 extern void brelse(struct buffer_head * buf);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
+extern void bread_multi(int dev,int * b,int nr,struct buffer_head ** bh);
 extern struct buffer_head * breada(int dev,int block,...);
-extern int new_block(int dev);
+extern struct buffer_head * get_dalloc(struct m_inode * inode,int block);
+extern struct buffer_head * getblk_dalloc(struct m_inode * inode,int block);
+extern void flush_dalloc(struct m_inode * inode);
+extern void drop_dalloc(struct m_inode * inode);
+extern void sync_dalloc(int dev);
+extern int new_block(int dev,int goal);
+extern int new_block_run(int dev,int goal,int * nr);
 extern void free_block(int dev, int block);
-extern struct m_inode * new_inode(int dev);
+extern void free_blocks(int dev, unsigned long * zone, int nr);
+extern struct m_inode * new_inode(struct m_inode * dir);
 extern void free_inode(struct m_inode * inode);
+extern unsigned long count_free(struct buffer_head ** map, unsigned long bits);
+extern void unpack_inode(struct m_inode * inode, struct d_inode * d);
+extern void pack_inode(struct d_inode * d, struct m_inode * inode);
 extern int sync_dev(int dev);
+extern void tmp_wait_page(unsigned long addr);
+extern int tmp_read_super(struct super_block * sb,int pages);
+extern void tmp_put_super(struct super_block * sb);
+extern int tmp_new_block(struct super_block * sb);
+extern void tmp_free_block(struct super_block * sb,int zone);
+extern int tmp_new_inode(struct super_block * sb);
+extern void tmp_free_inode(struct super_block * sb,int nr);
+extern int grp_read_super(struct super_block * sb, struct buffer_head * bh);
+extern int grp_inode_block(struct super_block * sb, int nr);
+extern int zone_goal(struct m_inode * inode);
+extern int read_start(struct m_inode * inode);
+extern void read_end(struct m_inode * inode, int gen);
 extern struct super_block * get_super(int dev);
 extern int ROOT_DEV;
 
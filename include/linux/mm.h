@@ -6,5 +6,7 @@
 extern unsigned long get_free_page(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern unsigned long get_free_pages(int nr);
+extern void free_pages(unsigned long addr, int nr);
 
 #endif
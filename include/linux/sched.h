@@ -12,10 +12,23 @@
 #include <linux/mm.h>
 #include <signal.h>
 
-#if (NR_OPEN > 32)
-#error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
+/*
+ * The fd table of a task is filp[max_fds], followed by two bitmaps of
+ * max_fds bits: the fds in use, and the close-on-exec ones. The first
+ * NR_OPEN_DEF fds are in the task struct; a task that needs more gets
+ * a table in fd_pages contiguous pages (1, 2 or 4), see get_unused_fd().
+ */
+#define FD_MAX_PAGES 4
+#define FDS_IN_PAGES(n) ((((n)*PAGE_SIZE*8)/34)&~31)
+
+#if (NR_OPEN > FDS_IN_PAGES(FD_MAX_PAGES)) || (NR_OPEN_DEF != 32)
+#error "NR_OPEN doesn't fit in FD_MAX_PAGES, or NR_OPEN_DEF isn't one word"
 #endif
 
+#define FD_ISSET(fd,map) (((map)[(fd)>>5]>>((fd)&31))&1)
+#define FD_SET(fd,map) ((map)[(fd)>>5] |= 1UL<<((fd)&31))
+#define FD_CLR(fd,map) ((map)[(fd)>>5] &= ~(1UL<<((fd)&31)))
+
 #define TASK_RUNNING		0
 #define TASK_INTERRUPTIBLE	1
 #define TASK_UNINTERRUPTIBLE	2
@@ -100,8 +113,14 @@ struct task_struct {
 	struct m_inode * pwd;
 	struct m_inode * root;
 	struct m_inode * executable;
-	unsigned long close_on_exec;
-	struct file * filp[NR_OPEN];
+	unsigned long max_fds;		/* slots in filp[] */
+	unsigned long next_fd;		/* no free fd below this one */
+	unsigned long fd_pages;		/* 0 - the table is fd_array[] */
+	struct file ** filp;
+	unsigned long * open_fds;
+	unsigned long * close_on_exec;
+	unsigned long fd_bits[2];	/* open_fds, close_on_exec */
+	struct file * fd_array[NR_OPEN_DEF];
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
 	struct desc_struct ldt[3];
 /* tss for this task */
@@ -120,8 +139,10 @@ struct task_struct {
 /* uid etc */	0,0,0,0,0,0, \
 /* alarm */	0,0,0,0,0,0, \
 /* math */	0, \
-/* fs info */	-1,0022,NULL,NULL,NULL,0, \
-/* filp */	{NULL,}, \
+/* fs info */	-1,0022,NULL,NULL,NULL, \
+/* fds */	NR_OPEN_DEF,0,0,init_task.task.fd_array, \
+		init_task.task.fd_bits,init_task.task.fd_bits+1, \
+		{0,0},{NULL,}, \
 	{ \
 		{0,0}, \
 /* ldt */	{0x9f,0xc0fa00}, \
@@ -147,6 +168,8 @@ extern void add_timer(long jiffies, void (*fn)(void));
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
+extern int copy_fds(struct task_struct * p);
+extern void free_fds(struct task_struct * p);
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
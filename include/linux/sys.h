@@ -70,6 +70,25 @@ extern int sys_sgetmask();
 extern int sys_ssetmask();
 extern int sys_setreuid();
 extern int sys_setregid();
+extern int sys_statfs();
+extern int sys_fstatfs();
+extern int sys_fsync();
+extern int sys_fdatasync();
+extern int sys_sync_file_range();
+extern int sys_getdents();
+extern int sys_getdents_plus();
+extern int sys_pread();
+extern int sys_pwrite();
+extern int sys_readv();
+extern int sys_writev();
+extern int sys_sendfile();
+extern int sys_splice();
+extern int sys_truncd();
+extern int sys_fallocate();
+extern int sys_defrag();
+extern int sys_inotify_init();
+extern int sys_inotify_add_watch();
+extern int sys_inotify_rm_watch();
 
 fn_ptr sys_call_table[] = { sys_setup, sys_exit, sys_fork, sys_read,
 sys_write, sys_open, sys_close, sys_waitpid, sys_creat, sys_link,
@@ -83,4 +102,8 @@ sys_getgid, sys_signal, sys_geteuid, sys_getegid, sys_acct, sys_phys,
 sys_lock, sys_ioctl, sys_fcntl, sys_mpx, sys_setpgid, sys_ulimit,
 sys_uname, sys_umask, sys_chroot, sys_ustat, sys_dup2, sys_getppid,
 sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
-sys_setreuid,sys_setregid };
+sys_setreuid,sys_setregid, sys_statfs, sys_fstatfs, sys_fsync,
+sys_fdatasync, sys_sync_file_range, sys_getdents, sys_getdents_plus,
+sys_pread, sys_pwrite, sys_readv, sys_writev, sys_sendfile, sys_splice,
+sys_truncd, sys_fallocate, sys_defrag, sys_inotify_init,
+sys_inotify_add_watch, sys_inotify_rm_watch };
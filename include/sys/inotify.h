@@ -0,0 +1,30 @@
+#ifndef _SYS_INOTIFY_H
+#define _SYS_INOTIFY_H
+
+#include <sys/types.h>
+
+/* read() returns whole events of this size, see fs/notify.c */
+struct inotify_event {
+	int wd;				/* watch, -1 for IN_Q_OVERFLOW */
+	unsigned long mask;
+	unsigned short len;		/* length of name, 0 if none */
+	char name[14];			/* not 0-terminated if 14 long */
+};
+
+#define IN_MODIFY	0x0002	/* file written or truncated */
+#define IN_ATTRIB	0x0004	/* mode, owner or links changed */
+#define IN_CREATE	0x0100	/* name added to watched directory */
+#define IN_DELETE	0x0200	/* name removed from watched directory */
+#define IN_DELETE_SELF	0x0400	/* watched inode itself freed */
+#define IN_ALL_EVENTS	0x0706
+
+#define IN_UNMOUNT	0x2000	/* filesystem of watched inode unmounted */
+#define IN_Q_OVERFLOW	0x4000	/* events were lost */
+#define IN_IGNORED	0x8000	/* watch removed */
+
+extern int inotify_init(void);
+extern int inotify_add_watch(int fildes, const char * pathname,
+	unsigned long mask);
+extern int inotify_rm_watch(int fildes, int wd);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _SYS_UIO_H
+#define _SYS_UIO_H
+
+#include <sys/types.h>
+
+#define UIO_MAXIOV 16	/* max segments in one readv() or writev() */
+
+struct iovec {
+	void * iov_base;
+	size_t iov_len;
+};
+
+extern int readv(int fildes, const struct iovec * iov, int iovcnt);
+extern int writev(int fildes, const struct iovec * iov, int iovcnt);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _SYS_VFS_H
+#define _SYS_VFS_H
+
+#include <sys/types.h>
+
+struct statfs {
+	long f_type;		/* super-block magic */
+	long f_bsize;		/* allocation unit, in bytes */
+	long f_blocks;		/* data zones in the filesystem */
+	long f_bfree;
+	long f_bavail;
+	long f_files;
+	long f_ffree;
+	long f_namelen;
+};
+
+extern int statfs(const char * path, struct statfs * buf);
+extern int fstatfs(int fildes, struct statfs * buf);
+
+#endif
@@ -28,6 +28,8 @@
 #define SEEK_SET	0
 #define SEEK_CUR	1
 #define SEEK_END	2
+#define SEEK_DATA	3
+#define SEEK_HOLE	4
 
 /* _SC stands for System Configuration. We don't use them much */
 #define _SC_ARG_MAX		1
@@ -129,6 +131,25 @@
 #define __NR_ssetmask	69
 #define __NR_setreuid	70
 #define __NR_setregid	71
+#define __NR_statfs	72
+#define __NR_fstatfs	73
+#define __NR_fsync	74
+#define __NR_fdatasync	75
+#define __NR_sync_file_range	76
+#define __NR_getdents	77
+#define __NR_getdents_plus	78
+#define __NR_pread	79
+#define __NR_pwrite	80
+#define __NR_readv	81
+#define __NR_writev	82
+#define __NR_sendfile	83
+#define __NR_splice	84
+#define __NR_truncd	85	/* used only by init, to start truncd */
+#define __NR_fallocate	86
+#define __NR_defrag	87
+#define __NR_inotify_init	88
+#define __NR_inotify_add_watch	89
+#define __NR_inotify_rm_watch	90
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -224,6 +245,9 @@ int open(const char * filename, int flag, ...);
 int pause(void);
 int pipe(int * fildes);
 int read(int fildes, char * buf, off_t count);
+int pread(int fildes, void * buf, size_t count, off_t offset);
+int pwrite(int fildes, const void * buf, size_t count, off_t offset);
+int sendfile(int out_fd, int in_fd, off_t * offset, off_t count);
 int setpgrp(void);
 int setpgid(pid_t pid,pid_t pgid);
 int setuid(uid_t uid);
@@ -233,6 +257,9 @@ int stat(const char * filename, struct stat * stat_buf);
 int fstat(int fildes, struct stat * stat_buf);
 int stime(time_t * tptr);
 int sync(void);
+int fsync(int fildes);
+int fdatasync(int fildes);
+int sync_file_range(int fildes, off_t offset, off_t nbytes);
 time_t time(time_t * tloc);
 time_t times(struct tms * tbuf);
 int ulimit(int cmd, long limit);
@@ -249,5 +276,7 @@ int dup2(int oldfd, int newfd);
 int getppid(void);
 pid_t getpgrp(void);
 pid_t setsid(void);
+int splice(int in_fd, int out_fd, off_t count);
+int defrag(int fildes);
 
 #endif
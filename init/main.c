@@ -24,7 +24,9 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall0(int,truncd)
 
+#include <linux/config.h>
 #include <linux/tty.h>
 #include <linux/sched.h>
 #include <linux/head.h>
@@ -176,6 +178,12 @@ void init(void)
 	printf("%d buffers = %d bytes buffer space\n\r",NR_BUFFERS,
 		NR_BUFFERS*BLOCK_SIZE);
 	printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
+#ifdef DEFER_TRUNCATE
+	if (!(pid=fork())) {
+		close(0);close(1);close(2);
+		_exit(truncd());	/* never returns */
+	}
+#endif
 	if (!(pid=fork())) {
 		close(0);
 		if (open("/etc/rc",O_RDONLY,0))
@@ -85,7 +85,7 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 	sti();
 }
 
-static void make_request(int major,int rw, struct buffer_head * bh)
+static void make_request(int major,int rw, struct buffer_head * bh, int nr)
 {
 	struct request * req;
 	int rw_ahead;
@@ -134,7 +134,7 @@ repeat:
 	req->cmd = rw;
 	req->errors=0;
 	req->sector = bh->b_blocknr<<1;
-	req->nr_sectors = 2;
+	req->nr_sectors = nr;
 	req->buffer = bh->b_data;
 	req->waiting = NULL;
 	req->bh = bh;
@@ -146,12 +146,35 @@ void ll_rw_block(int rw, struct buffer_head * bh)
 {
 	unsigned int major;
 
+	if (IS_CFS(bh->b_dev)) {
+		cfs_rw_block(rw,bh);
+		return;
+	}
+	if ((major=MAJOR(bh->b_dev)) >= NR_BLK_DEV ||
+	!(blk_dev[major].request_fn)) {
+		printk("Trying to read nonexistent block-device\n\r");
+		return;
+	}
+	make_request(major,rw,bh,2);
+}
+
+/*
+ * ll_rw_sectors() is ll_rw_block() for 'nr' sectors from block b_blocknr
+ * on. It's used by O_DIRECT, whose buffer heads aren't in the cache and
+ * point right into user memory. The floppy driver only does 2 sectors.
+ */
+void ll_rw_sectors(int rw, struct buffer_head * bh, int nr)
+{
+	unsigned int major;
+
 	if ((major=MAJOR(bh->b_dev)) >= NR_BLK_DEV ||
 	!(blk_dev[major].request_fn)) {
 		printk("Trying to read nonexistent block-device\n\r");
 		return;
 	}
-	make_request(major,rw,bh);
+	if (nr < 1 || (major == 2 && nr > 2))
+		panic("ll_rw_sectors: bad sector count");
+	make_request(major,rw,bh,nr);
 }
 
 void blk_dev_init(void)
@@ -67,14 +67,19 @@ long rd_init(long mem_start, int length)
  * If the root device is the ram disk, try to load it.
  * In order to do this, the root device is originally set to the
  * floppy, and we later change it to be ram disk.
+ *
+ * The image may also be a compressed one (see fs/cfs.c): then only the
+ * compressed image is loaded, and the root is the cfs on the ram disk.
  */
 void rd_load(void)
 {
 	struct buffer_head *bh;
-	struct super_block	s;
+	struct d_super_block	s;
+	struct cfs_header	h;
 	int		block = 256;	/* Start at block 256 */
 	int		i = 1;
 	int		nblocks;
+	int		root = 0x0101;
 	char		*cp;		/* Move pointer */
 	
 	if (!rd_length)
@@ -88,12 +93,26 @@ void rd_load(void)
 		printk("Disk error while looking for ramdisk!\n");
 		return;
 	}
-	*((struct d_super_block *) &s) = *((struct d_super_block *) bh->b_data);
+	s = *((struct d_super_block *) bh->b_data);
+	nblocks = ((struct d_grp_super_block *) bh->b_data)->s_nzones;
 	brelse(bh);
-	if (s.s_magic != SUPER_MAGIC)
-		/* No ram disk image present, assume normal floppy boot */
-		return;
-	nblocks = s.s_nzones << s.s_log_zone_size;
+	if (s.s_magic == SUPER_MAGIC)
+		nblocks = s.s_nzones << s.s_log_zone_size;
+	else if (s.s_magic == GRP_MAGIC)
+		nblocks <<= s.s_log_zone_size;
+	else {
+		if (!(bh = bread(ROOT_DEV,block))) {
+			printk("Disk error while looking for ramdisk!\n");
+			return;
+		}
+		h = *(struct cfs_header *) bh->b_data;
+		brelse(bh);
+		if (h.h_magic != CFS_MAGIC)
+			/* No ram disk image present, assume normal floppy boot */
+			return;
+		nblocks = (h.h_size + BLOCK_SIZE-1) >> BLOCK_SIZE_BITS;
+		root = (CFS_MAJOR<<8) | (1<<5) | 1;	/* cfs on /dev/ram */
+	}
 	if (nblocks > (rd_length >> BLOCK_SIZE_BITS)) {
 		printk("Ram disk image too big!  (%d blocks, %d avail)\n", 
 			nblocks, rd_length >> BLOCK_SIZE_BITS);
@@ -121,5 +140,5 @@ void rd_load(void)
 		i++;
 	}
 	printk("\010\010\010\010\010done \n");
-	ROOT_DEV=0x0101;
+	ROOT_DEV=root;
 }
@@ -292,16 +292,35 @@ int tty_write(unsigned channel, char * buf, int nr)
 {
 	static int cr_flag=0;
 	struct tty_struct * tty;
+	struct tty_queue * q;
 	char c, *b=buf;
+	char tmp[128];
+	int i,n;
 
 	if (channel>2 || nr<0) return -1;
 	tty = channel + tty_table;
+	q = &tty->write_q;
 	while (nr>0) {
-		sleep_if_full(&tty->write_q);
+		sleep_if_full(q);
 		if (current->signal)
 			break;
-		while (nr>0 && !FULL(tty->write_q)) {
-			c=get_fs_byte(b);
+/* without output processing, copy straight into the queue */
+		while (!O_POST(tty) && nr>0 && (n=LEFT(*q))) {
+			if (n > TTY_BUF_SIZE-q->head)
+				n = TTY_BUF_SIZE-q->head;
+			if (n > nr)
+				n = nr;
+			memcpy_fromfs(q->buf+q->head,b,n);
+			q->head = (q->head+n) & (TTY_BUF_SIZE-1);
+			b += n; nr -= n;
+		}
+		for (i=n=0 ; nr>0 && !FULL(*q) ; ) {
+			if (i == n) {
+				n = (nr < sizeof (tmp)) ? nr : sizeof (tmp);
+				memcpy_fromfs(tmp,b,n);
+				i = 0;
+			}
+			c=tmp[i];
 			if (O_POST(tty)) {
 				if (c=='\r' && O_CRNL(tty))
 					c='\n';
@@ -309,15 +328,15 @@ int tty_write(unsigned channel, char * buf, int nr)
 					c='\r';
 				if (c=='\n' && !cr_flag && O_NLCR(tty)) {
 					cr_flag = 1;
-					PUTCH(13,tty->write_q);
+					PUTCH(13,*q);
 					continue;
 				}
 				if (O_LCUC(tty))
 					c=toupper(c);
 			}
-			b++; nr--;
+			i++; b++; nr--;
 			cr_flag = 0;
-			PUTCH(c,tty->write_q);
+			PUTCH(c,*q);
 		}
 		tty->write(tty);
 		if (nr>0)
@@ -111,9 +111,10 @@ int do_exit(long code)
 				/* assumption task[1] is always init */
 				(void) send_sig(SIGCHLD, task[1], 1);
 		}
-	for (i=0 ; i<NR_OPEN ; i++)
+	for (i=0 ; i<current->max_fds ; i++)
 		if (current->filp[i])
 			sys_close(i);
+	free_fds(current);
 	iput(current->pwd);
 	current->pwd=NULL;
 	iput(current->root);
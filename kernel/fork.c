@@ -113,12 +113,18 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->tss.trace_bitmap = 0x80000000;
 	if (last_task_used_math == current)
 		__asm__("clts ; fnsave %0"::"m" (p->tss.i387));
+	if (copy_fds(p)) {
+		task[nr] = NULL;
+		free_page((long) p);
+		return -EAGAIN;
+	}
 	if (copy_mem(nr,p)) {
+		free_fds(p);
 		task[nr] = NULL;
 		free_page((long) p);
 		return -EAGAIN;
 	}
-	for (i=0; i<NR_OPEN;i++)
+	for (i=0; i<p->max_fds;i++)
 		if ((f=p->filp[i]))
 			f->f_count++;
 	if (current->pwd)
@@ -0,0 +1,8 @@
+/*
+ *  linux/lib/defrag.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+
+_syscall1(int,defrag,int,fildes)
@@ -0,0 +1,26 @@
+/*
+ *  linux/lib/fallocate.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+#include <fcntl.h>
+
+/* the kernel gets the offset and length in an array: see fs/fallocate.c */
+int fallocate(int fildes, int mode, off_t offset, off_t len)
+{
+	off_t range[2];
+	long __res;
+
+	range[0] = offset;
+	range[1] = len;
+	__asm__ volatile ("int $0x80"
+		: "=a" (__res)
+		: "0" (__NR_fallocate),"b" ((long)(fildes)),"c" ((long)(mode)),
+		  "d" ((long)(range))
+		: "memory");
+	if (__res>=0)
+		return (int) __res;
+	errno = -__res;
+	return -1;
+}
@@ -0,0 +1,12 @@
+/*
+ *  linux/lib/inotify.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+#include <sys/inotify.h>
+
+_syscall0(int,inotify_init)
+_syscall3(int,inotify_add_watch,int,fildes,const char *,pathname,
+	unsigned long,mask)
+_syscall2(int,inotify_rm_watch,int,fildes,int,wd)
@@ -0,0 +1,36 @@
+/*
+ *  linux/lib/pread.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* the kernel gets the buffer and count in an iovec: see fs/read_write.c */
+static int pio(int nr, int fildes, void * buf, size_t count, off_t offset)
+{
+	struct iovec iov;
+	long __res;
+
+	iov.iov_base = buf;
+	iov.iov_len = count;
+	__asm__ volatile ("int $0x80"
+		: "=a" (__res)
+		: "0" (nr),"b" ((long)(fildes)),"c" ((long)(&iov)),
+		  "d" ((long)(offset))
+		: "memory");
+	if (__res>=0)
+		return (int) __res;
+	errno = -__res;
+	return -1;
+}
+
+int pread(int fildes, void * buf, size_t count, off_t offset)
+{
+	return pio(__NR_pread,fildes,buf,count,offset);
+}
+
+int pwrite(int fildes, const void * buf, size_t count, off_t offset)
+{
+	return pio(__NR_pwrite,fildes,(void *) buf,count,offset);
+}
@@ -0,0 +1,27 @@
+/*
+ *  linux/lib/sendfile.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+
+/* the kernel gets the offset and count in an array: see fs/read_write.c */
+int sendfile(int out_fd, int in_fd, off_t * offset, off_t count)
+{
+	off_t range[2];
+	long __res;
+
+	range[0] = offset ? *offset : -1;
+	range[1] = count;
+	__asm__ volatile ("int $0x80"
+		: "=a" (__res)
+		: "0" (__NR_sendfile),"b" ((long)(out_fd)),"c" ((long)(in_fd)),
+		  "d" ((long)(range))
+		: "memory");
+	if (offset && __res>=0)
+		*offset = range[0];
+	if (__res>=0)
+		return (int) __res;
+	errno = -__res;
+	return -1;
+}
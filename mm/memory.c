@@ -21,6 +21,7 @@
  */
 
 #include <signal.h>
+#include <string.h>
 
 #include <asm/system.h>
 
@@ -82,6 +83,38 @@ __asm__("std ; repne ; scasb\n\t"
 return __res;
 }
 
+/*
+ * Get nr physically contiguous free pages, cleared, for tables that
+ * have to be bigger than a page (the fd tables, see fs/file_table.c).
+ * Returns the address of the first one, or 0.
+ */
+unsigned long get_free_pages(int nr)
+{
+	int i,n;
+
+	for (i=PAGING_PAGES-1,n=0 ; i>=0 ; i--) {
+		if (mem_map[i]) {
+			n = 0;
+			continue;
+		}
+		if (++n < nr)
+			continue;
+		for (n=0 ; n<nr ; n++)
+			mem_map[i+n] = 1;
+		memset((void *) (LOW_MEM+(i<<12)),0,nr*4096);
+		return LOW_MEM+(i<<12);
+	}
+	return 0;
+}
+
+void free_pages(unsigned long addr, int nr)
+{
+	while (nr-->0) {
+		free_page(addr);
+		addr += 4096;
+	}
+}
+
 /*
  * Free a page of memory at physical address 'addr'. Used by
  * 'free_page_tables()'
@@ -368,7 +401,7 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	int nr[4];
 	unsigned long tmp;
 	unsigned long page;
-	int block,i;
+	int block,i,gen;
 
 	address &= 0xfffff000;
 	tmp = address - current->start_code;
@@ -382,9 +415,12 @@ void do_no_page(unsigned long error_code,unsigned long address)
 		oom();
 /* remember that 1 block is used for header */
 	block = 1 + tmp/BLOCK_SIZE;
+	flush_dalloc(current->executable);
+	gen = read_start(current->executable);
 	for (i=0 ; i<4 ; block++,i++)
 		nr[i] = bmap(current->executable,block);
 	bread_page(page,current->executable->i_dev,nr);
+	read_end(current->executable,gen);
 	i = tmp + 4096 - current->end_data;
 	tmp = page + 4096;
 	while (i-- > 0) {
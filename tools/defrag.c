@@ -0,0 +1,52 @@
+/*
+ *  linux/tools/defrag.c
+ */
+
+/*
+ * defrag moves each of the files it is given to contiguous zones, with
+ * the defrag() system call (see fs/defrag.c):
+ *
+ *	defrag file...
+ *
+ * Unlike the other tools it runs under linux itself, on mounted
+ * filesystems, and the files may be in use while it runs. It needs
+ * write permission on them.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static void complain(const char * name, const char * str)
+{
+	write(2,"defrag: ",8);
+	write(2,name,strlen(name));
+	write(2,": ",2);
+	write(2,str,strlen(str));
+	write(2,"\n",1);
+}
+
+int main(int argc, char ** argv)
+{
+	int i,fd,ret = 0;
+
+	for (i=1 ; i<argc ; i++) {
+		if ((fd = open(argv[i],O_RDWR)) < 0) {
+			complain(argv[i],"can't open");
+			ret = 1;
+			continue;
+		}
+		if (defrag(fd) < 0) {
+			if (errno == ENOSPC)
+				complain(argv[i],"no room for a contiguous copy");
+			else if (errno == EBUSY)
+				complain(argv[i],"file kept changing, try again");
+			else
+				complain(argv[i],"failed");
+			ret = 1;
+		}
+		close(fd);
+	}
+	return ret;
+}
@@ -0,0 +1,391 @@
+/*
+ *  linux/tools/dirhash.c
+ */
+
+/*
+ * dirhash rebuilds a directory of a minix filesystem image as a hashed
+ * directory (see struct dir_hash in include/linux/fs.h):
+ *
+ *	dirhash image /path/in/image
+ *
+ * The directory gets new blocks: block 0 holds ".", ".." and the hash
+ * header, blocks 1..buckets the entries, placed by hash with linear
+ * probing over whole blocks. The buckets are sized to be about half full,
+ * so that the kernel can keep adding names for a long time before it
+ * has to drop the index. Older kernels just see a linear directory.
+ *
+ * Run it on an unmounted image only.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define BLOCK_SIZE 1024
+#define NAME_LEN 14
+#define ROOT_INO 1
+#define SUPER_MAGIC 0x137F
+#define DIR_HASH_MAGIC 0x4844
+#define DIR_ENTRIES_PER_BLOCK (BLOCK_SIZE/16)
+#define INODES_PER_BLOCK (BLOCK_SIZE/32)
+
+/* the on-disk structures, with host-independent field sizes */
+struct d_super_block {
+	unsigned short s_ninodes;
+	unsigned short s_nzones;
+	unsigned short s_imap_blocks;
+	unsigned short s_zmap_blocks;
+	unsigned short s_firstdatazone;
+	unsigned short s_log_zone_size;
+	unsigned int s_max_size;
+	unsigned short s_magic;
+};
+
+struct d_inode {
+	unsigned short i_mode;
+	unsigned short i_uid;
+	unsigned int i_size;
+	unsigned int i_time;
+	unsigned char i_gid;
+	unsigned char i_nlinks;
+	unsigned short i_zone[9];
+};
+
+struct dir_entry {
+	unsigned short inode;
+	char name[NAME_LEN];
+};
+
+struct dir_hash {
+	unsigned short inode;
+	char zero;
+	char version;
+	unsigned short magic;
+	unsigned short buckets;
+	char pad[NAME_LEN-6];
+};
+
+static int fd;
+static struct d_super_block sb;
+static unsigned char * zmap;
+static int shift;		/* log2 of blocks per zone */
+
+static void die(const char * str)
+{
+	fprintf(stderr,"dirhash: %s\n",str);
+	exit(1);
+}
+
+static void rw_block(int rw, int block, void * buf)
+{
+	if (lseek(fd,(off_t) block*BLOCK_SIZE,SEEK_SET) < 0)
+		die("seek failed");
+	if ((rw ? write(fd,buf,BLOCK_SIZE) : read(fd,buf,BLOCK_SIZE))
+	    != BLOCK_SIZE)
+		die(rw ? "write failed" : "read failed");
+}
+
+static int inode_block(int nr)
+{
+	return 2 + sb.s_imap_blocks + sb.s_zmap_blocks +
+		(nr-1)/INODES_PER_BLOCK;
+}
+
+static void rw_inode(int rw, int nr, struct d_inode * inode)
+{
+	struct d_inode buf[INODES_PER_BLOCK];
+
+	rw_block(0,inode_block(nr),buf);
+	if (!rw) {
+		*inode = buf[(nr-1)%INODES_PER_BLOCK];
+		return;
+	}
+	buf[(nr-1)%INODES_PER_BLOCK] = *inode;
+	rw_block(1,inode_block(nr),buf);
+}
+
+static int zone_bit(int zone)
+{
+	return zone - sb.s_firstdatazone + 1;
+}
+
+static void free_zone(int zone)
+{
+	int bit = zone_bit(zone);
+
+	if (zone < sb.s_firstdatazone || zone >= sb.s_nzones)
+		die("bad zone in directory");
+	zmap[bit>>3] &= ~(1 << (bit&7));
+}
+
+/* first free zone at or after 'goal', so that the new blocks stay together */
+static int new_zone(int goal)
+{
+	static char zero[BLOCK_SIZE];
+	int zone,bit,i;
+
+	if (goal < sb.s_firstdatazone)
+		goal = sb.s_firstdatazone;
+	for (zone = goal ; zone < sb.s_nzones ; zone++) {
+		bit = zone_bit(zone);
+		if (!(zmap[bit>>3] & (1 << (bit&7)))) {
+			zmap[bit>>3] |= 1 << (bit&7);
+			for (i=0 ; i < (1<<shift) ; i++)
+				rw_block(1,(zone<<shift)+i,zero);
+			return zone;
+		}
+	}
+	if (goal > sb.s_firstdatazone)
+		return new_zone(sb.s_firstdatazone);
+	die("no space left on image");
+	return 0;
+}
+
+/* file zone 'nr' to disk zone: indirect zones hold zone numbers */
+static int zone_bmap(struct d_inode * inode, int nr)
+{
+	unsigned short ind[BLOCK_SIZE/2];
+
+	if (nr < 7)
+		return inode->i_zone[nr];
+	nr -= 7;
+	if (nr < 512) {
+		if (!inode->i_zone[7])
+			return 0;
+		rw_block(0,inode->i_zone[7]<<shift,ind);
+		return ind[nr];
+	}
+	nr -= 512;
+	if (!inode->i_zone[8])
+		return 0;
+	rw_block(0,inode->i_zone[8]<<shift,ind);
+	if (!ind[nr>>9])
+		return 0;
+	rw_block(0,ind[nr>>9]<<shift,ind);
+	return ind[nr&511];
+}
+
+static int bmap(struct d_inode * inode, int block)
+{
+	int zone = zone_bmap(inode,block>>shift);
+
+	return zone ? (zone<<shift) + (block & ((1<<shift)-1)) : 0;
+}
+
+/* map file zone 'nr' to 'zone', allocating the indirect zones needed */
+static void set_bmap(struct d_inode * inode, int nr, int zone)
+{
+	unsigned short ind[BLOCK_SIZE/2];
+	int i;
+
+	if (nr < 7) {
+		inode->i_zone[nr] = zone;
+		return;
+	}
+	nr -= 7;
+	if (nr < 512) {
+		if (!inode->i_zone[7])
+			inode->i_zone[7] = new_zone(zone);
+		rw_block(0,inode->i_zone[7]<<shift,ind);
+		ind[nr] = zone;
+		rw_block(1,inode->i_zone[7]<<shift,ind);
+		return;
+	}
+	nr -= 512;
+	if (!inode->i_zone[8])
+		inode->i_zone[8] = new_zone(zone);
+	rw_block(0,inode->i_zone[8]<<shift,ind);
+	if (!(i = ind[nr>>9])) {
+		i = ind[nr>>9] = new_zone(zone);
+		rw_block(1,inode->i_zone[8]<<shift,ind);
+	}
+	rw_block(0,i<<shift,ind);
+	ind[nr&511] = zone;
+	rw_block(1,i<<shift,ind);
+}
+
+static void free_zones(struct d_inode * inode)
+{
+	unsigned short ind[BLOCK_SIZE/2], dind[BLOCK_SIZE/2];
+	int i,j;
+
+	for (i=0 ; i<7 ; i++)
+		if (inode->i_zone[i])
+			free_zone(inode->i_zone[i]);
+	if (inode->i_zone[7]) {
+		rw_block(0,inode->i_zone[7]<<shift,ind);
+		for (i=0 ; i<512 ; i++)
+			if (ind[i])
+				free_zone(ind[i]);
+		free_zone(inode->i_zone[7]);
+	}
+	if (inode->i_zone[8]) {
+		rw_block(0,inode->i_zone[8]<<shift,dind);
+		for (i=0 ; i<512 ; i++) {
+			if (!dind[i])
+				continue;
+			rw_block(0,dind[i]<<shift,ind);
+			for (j=0 ; j<512 ; j++)
+				if (ind[j])
+					free_zone(ind[j]);
+			free_zone(dind[i]);
+		}
+		free_zone(inode->i_zone[8]);
+	}
+	memset(inode->i_zone,0,sizeof (inode->i_zone));
+}
+
+/* same as dir_hash() in fs/namei.c */
+static unsigned int dir_hash(const char * name, int len)
+{
+	unsigned int h = 0;
+
+	while (len-- > 0)
+		h = (h<<5) - h + (unsigned char) *(name++);
+	return h;
+}
+
+static int namelen(const struct dir_entry * de)
+{
+	int len = 0;
+
+	while (len < NAME_LEN && de->name[len])
+		len++;
+	return len;
+}
+
+/* read all the entries of a directory into one malloc'ed array */
+static struct dir_entry * read_dir(struct d_inode * dir, int * nr)
+{
+	struct dir_entry * de;
+	int i,block,entries;
+
+	entries = dir->i_size / sizeof (struct dir_entry);
+	entries = (entries + DIR_ENTRIES_PER_BLOCK-1) &
+		~(DIR_ENTRIES_PER_BLOCK-1);
+	if (!(de = calloc(entries,sizeof (struct dir_entry))))
+		die("out of memory");
+	for (i=0 ; i*DIR_ENTRIES_PER_BLOCK < entries ; i++)
+		if ((block = bmap(dir,i)))
+			rw_block(0,block,de+i*DIR_ENTRIES_PER_BLOCK);
+	*nr = dir->i_size / sizeof (struct dir_entry);
+	return de;
+}
+
+static int lookup(int dir_nr, const char * name, int len)
+{
+	struct d_inode dir;
+	struct dir_entry * de;
+	int i,nr,res = 0;
+
+	rw_inode(0,dir_nr,&dir);
+	if ((dir.i_mode & S_IFMT) != S_IFDIR)
+		die("not a directory");
+	de = read_dir(&dir,&nr);
+	for (i=0 ; i<nr ; i++)
+		if (de[i].inode && namelen(de+i) == len &&
+		    !strncmp(de[i].name,name,len)) {
+			res = de[i].inode;
+			break;
+		}
+	free(de);
+	return res;
+}
+
+static int namei(const char * path)
+{
+	const char * p;
+	int nr = ROOT_INO;
+
+	while (*path) {
+		if (*path == '/') {
+			path++;
+			continue;
+		}
+		for (p = path ; *p && *p != '/' ; p++)
+			/* nothing */ ;
+		if (!(nr = lookup(nr,path,
+		    (p-path > NAME_LEN) ? NAME_LEN : p-path)))
+			die("no such directory in image");
+		path = p;
+	}
+	return nr;
+}
+
+int main(int argc, char ** argv)
+{
+	char buf[BLOCK_SIZE];
+	struct d_inode dir;
+	struct dir_entry * old, * new, * de;
+	struct dir_hash * h;
+	int nr,dir_nr,buckets,entries,i,j,k,zone,goal,zones;
+
+	if (argc != 3)
+		die("usage: dirhash image /path/in/image");
+	if ((fd = open(argv[1],O_RDWR)) < 0)
+		die("unable to open image");
+	rw_block(0,1,buf);
+	memcpy(&sb,buf,sizeof (sb));
+	if (sb.s_magic != SUPER_MAGIC)
+		die("not a minix filesystem");
+	shift = sb.s_log_zone_size;
+	if (!(zmap = malloc(sb.s_zmap_blocks*BLOCK_SIZE)))
+		die("out of memory");
+	for (i=0 ; i<sb.s_zmap_blocks ; i++)
+		rw_block(0,2+sb.s_imap_blocks+i,zmap+i*BLOCK_SIZE);
+	dir_nr = namei(argv[2]);
+	rw_inode(0,dir_nr,&dir);
+	if ((dir.i_mode & S_IFMT) != S_IFDIR)
+		die("not a directory");
+	old = read_dir(&dir,&nr);
+	if (nr < 2 || old[0].inode != dir_nr || strcmp(old[0].name,".") ||
+	    strcmp(old[1].name,".."))
+		die("bad directory");
+	for (entries=0,i=2 ; i<nr ; i++)
+		if (old[i].inode)
+			entries++;
+	buckets = entries/(DIR_ENTRIES_PER_BLOCK/2) + 1;
+	zones = (buckets+1 + (1<<shift)-1) >> shift;
+	if (zones > 7+512+512*512)
+		die("directory too big");
+	if (!(new = calloc((buckets+1)*DIR_ENTRIES_PER_BLOCK,
+	    sizeof (struct dir_entry))))
+		die("out of memory");
+	new[0] = old[0];
+	new[1] = old[1];
+	h = (struct dir_hash *) (new+2);
+	h->magic = DIR_HASH_MAGIC;
+	h->buckets = buckets;
+	for (i=2 ; i<nr ; i++) {
+		if (!old[i].inode)
+			continue;
+		k = dir_hash(old[i].name,namelen(old+i)) % buckets;
+		for (j=0 ; j<buckets ; j++,k = (k+1) % buckets) {
+			de = new + (1+k)*DIR_ENTRIES_PER_BLOCK;
+			while (de < new + (2+k)*DIR_ENTRIES_PER_BLOCK &&
+			       de->inode)
+				de++;
+			if (de < new + (2+k)*DIR_ENTRIES_PER_BLOCK)
+				break;
+		}
+		*de = old[i];
+	}
+	goal = dir.i_zone[0];
+	free_zones(&dir);
+	for (i=0 ; i<zones ; i++) {
+		goal = zone = new_zone(goal);
+		set_bmap(&dir,i,zone);
+	}
+	for (i=0 ; i<=buckets ; i++)
+		rw_block(1,bmap(&dir,i),new+i*DIR_ENTRIES_PER_BLOCK);
+	dir.i_size = (buckets+1)*BLOCK_SIZE;
+	rw_inode(1,dir_nr,&dir);
+	for (i=0 ; i<sb.s_zmap_blocks ; i++)
+		rw_block(1,2+sb.s_imap_blocks+i,zmap+i*BLOCK_SIZE);
+	fprintf(stderr,"%d entries in %d hashed blocks\n",entries,buckets);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ *  linux/tools/mkcfs.c
+ */
+
+/*
+ * mkcfs makes a compressed, read-only image of a minix filesystem image
+ * (see fs/cfs.c for the format):
+ *
+ *	mkcfs minix-image cfs-image
+ *
+ * The free zones and free inodes of the filesystem are cleared first, so
+ * that whatever deleted files left there doesn't take any room. Each
+ * chunk is then compressed with LZSS on its own, as the kernel reads
+ * them one at a time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define BLOCK_SIZE 1024
+#define SUPER_MAGIC 0x137F
+#define CFS_MAGIC 0x31534643
+#define CHUNK_BITS 2
+#define CHUNK (BLOCK_SIZE<<CHUNK_BITS)
+#define INODE_SIZE 32
+
+#define HASH_SIZE 4096
+#define MAX_DIST 4096
+#define MIN_MATCH 3
+#define MAX_MATCH 18
+#define MAX_CHAIN 64
+
+struct d_super_block {
+	unsigned short s_ninodes;
+	unsigned short s_nzones;
+	unsigned short s_imap_blocks;
+	unsigned short s_zmap_blocks;
+	unsigned short s_firstdatazone;
+	unsigned short s_log_zone_size;
+	unsigned int s_max_size;
+	unsigned short s_magic;
+};
+
+struct cfs_header {
+	unsigned int h_magic;
+	unsigned int h_chunks;
+	unsigned int h_size;
+};
+
+static void die(const char * str)
+{
+	fprintf(stderr,"mkcfs: %s\n",str);
+	exit(1);
+}
+
+static int bit(unsigned char * map, int nr)
+{
+	return map[nr>>3] & (1 << (nr&7));
+}
+
+/* clear the free zones and inodes of the image 'img' of 'blocks' blocks */
+static void clear_free(unsigned char * img, int blocks)
+{
+	struct d_super_block sb;
+	unsigned char * imap, * zmap;
+	int shift,zone,nr,first_inode;
+
+	memcpy(&sb,img+BLOCK_SIZE,sizeof (sb));
+	if (sb.s_magic != SUPER_MAGIC)
+		die("not a minix filesystem");
+	shift = sb.s_log_zone_size;
+	if ((sb.s_nzones << shift) > blocks)
+		die("image is truncated");
+	imap = img + 2*BLOCK_SIZE;
+	zmap = imap + sb.s_imap_blocks*BLOCK_SIZE;
+	first_inode = (2 + sb.s_imap_blocks + sb.s_zmap_blocks) * BLOCK_SIZE;
+	for (nr=1 ; nr <= sb.s_ninodes ; nr++)
+		if (!bit(imap,nr))
+			memset(img+first_inode+(nr-1)*INODE_SIZE,0,INODE_SIZE);
+	for (zone = sb.s_firstdatazone ; zone < sb.s_nzones ; zone++)
+		if (!bit(zmap,zone - sb.s_firstdatazone + 1))
+			memset(img+(zone << shift)*BLOCK_SIZE,0,
+				BLOCK_SIZE << shift);
+}
+
+#define HASH(p) ((((p)[0]<<8) ^ ((p)[1]<<4) ^ (p)[2]) & (HASH_SIZE-1))
+
+/* returns the compressed size, or CHUNK if it doesn't get any smaller */
+static int compress(unsigned char * in, unsigned char * out)
+{
+	short head[HASH_SIZE], prev[CHUNK];
+	int i,j,n,flags,bits,len,best,dist,chain;
+
+	memset(head,-1,sizeof (head));
+	i = n = flags = 0;
+	bits = 8;
+	while (i < CHUNK) {
+		if (n >= CHUNK-2)
+			return CHUNK;
+		if (bits == 8) {
+			flags = n++;
+			out[flags] = 0;
+			bits = 0;
+		}
+		best = dist = 0;
+		if (i+MIN_MATCH <= CHUNK)
+			for (j = head[HASH(in+i)], chain = 0 ;
+			     j >= 0 && i-j <= MAX_DIST && chain < MAX_CHAIN ;
+			     j = prev[j], chain++) {
+				for (len=0 ; len < MAX_MATCH && i+len < CHUNK &&
+				     in[j+len] == in[i+len] ; len++)
+					/* nothing */ ;
+				if (len > best) {
+					best = len;
+					dist = i-j;
+					if (len == MAX_MATCH)
+						break;
+				}
+			}
+		if (best < MIN_MATCH) {
+			out[flags] |= 1 << bits;
+			out[n++] = in[i];
+			best = 1;
+		} else {
+			out[n++] = (dist-1) & 0xff;
+			out[n++] = (((dist-1) >> 8) << 4) | (best-MIN_MATCH);
+		}
+		for ( ; best-- ; i++)
+			if (i+MIN_MATCH <= CHUNK) {
+				prev[i] = head[HASH(in+i)];
+				head[HASH(in+i)] = i;
+			}
+		bits++;
+	}
+	return (n < CHUNK) ? n : CHUNK;
+}
+
+static int zero_chunk(unsigned char * p)
+{
+	int i;
+
+	for (i=0 ; i<CHUNK ; i++)
+		if (p[i])
+			return 0;
+	return 1;
+}
+
+int main(int argc, char ** argv)
+{
+	struct cfs_header h;
+	unsigned char * img, * out;
+	unsigned int * index;
+	unsigned char buf[CHUNK];
+	int in_fd,out_fd,size,blocks,chunk,n,pos,i;
+
+	if (argc != 3)
+		die("usage: mkcfs minix-image cfs-image");
+	if ((in_fd = open(argv[1],O_RDONLY)) < 0)
+		die("unable to open image");
+	if ((size = lseek(in_fd,0,SEEK_END)) < 2*BLOCK_SIZE)
+		die("image too small");
+	blocks = size / BLOCK_SIZE;
+	h.h_magic = CFS_MAGIC;
+	h.h_chunks = (blocks + (1<<CHUNK_BITS)-1) >> CHUNK_BITS;
+	if (!(img = calloc(h.h_chunks,CHUNK)) ||
+	    !(out = malloc(h.h_chunks*CHUNK)) ||
+	    !(index = calloc(h.h_chunks+1,sizeof (unsigned int))))
+		die("out of memory");
+	if (lseek(in_fd,0,SEEK_SET) < 0 ||
+	    read(in_fd,img,blocks*BLOCK_SIZE) != blocks*BLOCK_SIZE)
+		die("read failed");
+	close(in_fd);
+	clear_free(img,blocks);
+	pos = BLOCK_SIZE + (h.h_chunks+1)*sizeof (unsigned int);
+	pos = (pos + BLOCK_SIZE-1) & ~(BLOCK_SIZE-1);
+	for (n=chunk=0 ; chunk < h.h_chunks ; chunk++) {
+		index[chunk] = pos+n;
+		if (zero_chunk(img+chunk*CHUNK))
+			continue;
+		if ((i = compress(img+chunk*CHUNK,buf)) < CHUNK)
+			memcpy(out+n,buf,i);
+		else
+			memcpy(out+n,img+chunk*CHUNK,CHUNK);
+		n += i;
+	}
+	index[chunk] = pos+n;
+	h.h_size = pos+n;
+	if ((out_fd = open(argv[2],O_WRONLY|O_CREAT|O_TRUNC,0666)) < 0)
+		die("unable to create image");
+	memset(buf,0,BLOCK_SIZE);
+	memcpy(buf,&h,sizeof (h));
+	if (write(out_fd,buf,BLOCK_SIZE) != BLOCK_SIZE ||
+	    write(out_fd,index,(h.h_chunks+1)*sizeof (unsigned int)) !=
+	    (h.h_chunks+1)*sizeof (unsigned int) ||
+	    lseek(out_fd,pos,SEEK_SET) != pos ||
+	    write(out_fd,out,n) != n)
+		die("write failed");
+	close(out_fd);
+	fprintf(stderr,"%d blocks in %d bytes (%d%%)\n",blocks,h.h_size,
+		(int) ((h.h_size*100LL) / (blocks*BLOCK_SIZE)));
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ *  linux/tools/mkgfs.c
+ */
+
+/*
+ * mkgfs makes an empty group filesystem (see include/linux/fs.h):
+ *
+ *	mkgfs device blocks [inodes]
+ *
+ * Each group of 8192 blocks starts with its zone-map, its inode-map and
+ * its inode table; the inodes are shared out evenly among the groups.
+ * Only the metadata is written: the data blocks are left as they are.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define BLOCK_SIZE 1024
+#define GRP_MAGIC 0x4752
+#define GRP_ZONES 8192
+#define INODES_PER_BLOCK (BLOCK_SIZE/sizeof (struct g_inode))
+#define DESC_PER_BLOCK (BLOCK_SIZE/sizeof (struct grp_desc))
+#define MAX_GROUPS (8*DESC_PER_BLOCK)
+#define ROOT_INO 1
+
+struct g_inode {
+	unsigned short i_mode;
+	unsigned short i_uid;
+	unsigned int i_size;
+	unsigned int i_time;
+	unsigned char i_gid;
+	unsigned char i_nlinks;
+	unsigned short i_pad;
+	unsigned int i_zone[9];
+	unsigned int i_spare[3];
+};
+
+struct d_grp_super_block {
+	unsigned short s_ninodes;
+	unsigned short s_ngroups;
+	unsigned int s_nzones;
+	unsigned short s_ipg;
+	unsigned short s_log_zone_size;
+	unsigned int s_max_size;
+	unsigned short s_magic;
+};
+
+struct grp_desc {
+	unsigned int g_zmap;
+	unsigned int g_imap;
+	unsigned int g_itable;
+	unsigned short g_free_zones;
+	unsigned short g_free_inodes;
+};
+
+struct dir_entry {
+	unsigned short inode;
+	char name[14];
+};
+
+static int fd;
+static struct grp_desc desc[MAX_GROUPS];
+
+static void die(const char * str)
+{
+	fprintf(stderr,"mkgfs: %s\n",str);
+	exit(1);
+}
+
+static void write_block(int block, void * buf)
+{
+	if (lseek(fd,(off_t) block*BLOCK_SIZE,SEEK_SET) < 0 ||
+	    write(fd,buf,BLOCK_SIZE) != BLOCK_SIZE)
+		die("write failed");
+}
+
+static void set_bits(unsigned char * map, int from, int to)
+{
+	for ( ; from < to ; from++)
+		map[from>>3] |= 1 << (from&7);
+}
+
+/* the first block of the data of group 'g' */
+static int data_start(int g, int ndesc, int ipg)
+{
+	return g*GRP_ZONES + (g ? 0 : 2+ndesc) + 2 + ipg/INODES_PER_BLOCK;
+}
+
+int main(int argc, char ** argv)
+{
+	struct d_grp_super_block sb;
+	unsigned char buf[BLOCK_SIZE];
+	struct g_inode * root;
+	struct dir_entry * de;
+	int blocks,inodes,ngroups,ndesc,ipg,g,end,start,i,root_zone;
+
+	if (argc != 3 && argc != 4)
+		die("usage: mkgfs device blocks [inodes]");
+	blocks = atoi(argv[2]);
+	inodes = (argc == 4) ? atoi(argv[3]) : blocks/3;
+	if (inodes < 16)
+		inodes = 16;
+	for (;;) {
+		ngroups = (blocks + GRP_ZONES-1) / GRP_ZONES;
+		if (ngroups < 1 || ngroups > MAX_GROUPS)
+			die("bad number of blocks");
+		ndesc = (ngroups + DESC_PER_BLOCK-1) / DESC_PER_BLOCK;
+		ipg = (inodes + ngroups-1) / ngroups;
+		ipg = (ipg + INODES_PER_BLOCK-1) & ~(INODES_PER_BLOCK-1);
+		if (ipg > GRP_ZONES)
+			ipg = GRP_ZONES;
+		while (ngroups*ipg > 0xffff)
+			ipg -= INODES_PER_BLOCK;
+		/* a last group with no room for data is left out */
+		if (blocks - data_start(ngroups-1,ndesc,ipg) >= 16)
+			break;
+		if (ngroups == 1)
+			die("too few blocks");
+		blocks = (ngroups-1) * GRP_ZONES;
+	}
+	if ((fd = open(argv[1],O_RDWR|O_CREAT,0666)) < 0)
+		die("unable to open device");
+	for (g=0 ; g<ngroups ; g++) {
+		start = g*GRP_ZONES + (g ? 0 : 2+ndesc);
+		desc[g].g_zmap = start;
+		desc[g].g_imap = start+1;
+		desc[g].g_itable = start+2;
+		end = blocks - g*GRP_ZONES;
+		if (end > GRP_ZONES)
+			end = GRP_ZONES;
+		desc[g].g_free_zones = end - (data_start(g,ndesc,ipg) - g*GRP_ZONES);
+		desc[g].g_free_inodes = ipg;
+	}
+	root_zone = data_start(0,ndesc,ipg);
+	desc[0].g_free_zones--;
+	desc[0].g_free_inodes--;
+	for (g=0 ; g<ngroups ; g++) {
+		memset(buf,0,BLOCK_SIZE);
+		end = blocks - g*GRP_ZONES;
+		set_bits(buf,0,data_start(g,ndesc,ipg) - g*GRP_ZONES + !g);
+		if (end < GRP_ZONES)
+			set_bits(buf,end,GRP_ZONES);
+		write_block(desc[g].g_zmap,buf);
+		memset(buf,0,BLOCK_SIZE);
+		set_bits(buf,ipg,GRP_ZONES);
+		if (!g)
+			set_bits(buf,0,1);
+		write_block(desc[g].g_imap,buf);
+		for (i=0 ; i < ipg/INODES_PER_BLOCK ; i++) {
+			memset(buf,0,BLOCK_SIZE);
+			if (!g && !i) {
+				root = (struct g_inode *) buf;
+				root->i_mode = 040755;
+				root->i_uid = getuid();
+				root->i_gid = getgid();
+				root->i_size = 2*sizeof (struct dir_entry);
+				root->i_time = time(NULL);
+				root->i_nlinks = 2;
+				root->i_zone[0] = root_zone;
+			}
+			write_block(desc[g].g_itable+i,buf);
+		}
+	}
+	memset(buf,0,BLOCK_SIZE);
+	de = (struct dir_entry *) buf;
+	de[0].inode = de[1].inode = ROOT_INO;
+	strcpy(de[0].name,".");
+	strcpy(de[1].name,"..");
+	write_block(root_zone,buf);
+	for (i=0 ; i<ndesc ; i++)
+		write_block(2+i,desc+i*DESC_PER_BLOCK);
+	memset(&sb,0,sizeof (sb));
+	sb.s_ninodes = ngroups*ipg;
+	sb.s_ngroups = ngroups;
+	sb.s_nzones = blocks;
+	sb.s_ipg = ipg;
+	sb.s_log_zone_size = 0;
+	sb.s_max_size = (7+256+256*256) * BLOCK_SIZE;
+	sb.s_magic = GRP_MAGIC;
+	memset(buf,0,BLOCK_SIZE);
+	memcpy(buf,&sb,sizeof (sb));
+	write_block(1,buf);
+	memset(buf,0,BLOCK_SIZE);
+	write_block(0,buf);
+	if (lseek(fd,0,SEEK_END) < (off_t) blocks*BLOCK_SIZE)	/* an image */
+		if (lseek(fd,(off_t) blocks*BLOCK_SIZE-1,SEEK_SET) < 0 ||
+		    write(fd,"",1) != 1)
+			die("write failed");
+	fprintf(stderr,"%d blocks, %d groups, %d inodes\n",blocks,ngroups,
+		ngroups*ipg);
+	close(fd);
+	return 0;
+}
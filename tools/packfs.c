@@ -0,0 +1,420 @@
+/*
+ *  linux/tools/packfs.c
+ */
+
+/*
+ * packfs builds a minix filesystem image from a directory tree:
+ *
+ *	packfs [-t trace] [-b blocks] [-i inodes] directory image
+ *
+ * Every file is laid out in one piece, each indirect block right before
+ * the blocks it maps, in the order the kernel reads them. The files named
+ * in the trace (one path per line, as seen from the root of the image,
+ * in the order they are used at boot: /etc/rc, /bin/sh...) come first,
+ * each directory just before the first of its files to be placed. The
+ * rest follows directory by directory, the files of a directory before
+ * its subdirectories. Inodes are numbered in the same order, so that the
+ * ones used together share inode blocks. A boot from the image is then
+ * close to one sweep over the disk.
+ *
+ * By default the image gets a tenth of its size free, and a quarter more
+ * inodes than it needs. Symbolic links and sockets are left out.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define BLOCK_SIZE 1024
+#define NAME_LEN 14
+#define SUPER_MAGIC 0x137F
+#define INODES_PER_BLOCK (BLOCK_SIZE/32)
+#define MAX_BLOCKS (7+512+512*512)
+
+struct d_super_block {
+	unsigned short s_ninodes;
+	unsigned short s_nzones;
+	unsigned short s_imap_blocks;
+	unsigned short s_zmap_blocks;
+	unsigned short s_firstdatazone;
+	unsigned short s_log_zone_size;
+	unsigned int s_max_size;
+	unsigned short s_magic;
+};
+
+struct d_inode {
+	unsigned short i_mode;
+	unsigned short i_uid;
+	unsigned int i_size;
+	unsigned int i_time;
+	unsigned char i_gid;
+	unsigned char i_nlinks;
+	unsigned short i_zone[9];
+};
+
+struct dir_entry {
+	unsigned short inode;
+	char name[NAME_LEN];
+};
+
+struct node {
+	char * path;			/* on the host */
+	char name[NAME_LEN+1];
+	struct stat st;
+	struct node * parent;
+	struct node * child;		/* sorted by name */
+	struct node * next;
+	struct node * link;		/* the first name of a hard link */
+	int entries;			/* of a directory */
+	int nlinks;
+	int ino;			/* 0 until it's placed */
+	int * zones;			/* of its data blocks */
+};
+
+static int fd;
+static int nr_nodes = 0;
+static int next_ino = 1;
+static int next_zone;
+static struct d_inode * itable;
+static struct node ** links = NULL;
+static int nr_links = 0;
+
+static void die(const char * str)
+{
+	fprintf(stderr,"packfs: %s\n",str);
+	exit(1);
+}
+
+static void write_block(int block, void * buf)
+{
+	if (lseek(fd,(off_t) block*BLOCK_SIZE,SEEK_SET) < 0 ||
+	    write(fd,buf,BLOCK_SIZE) != BLOCK_SIZE)
+		die("write failed");
+}
+
+static void set_bits(unsigned char * map, int from, int to)
+{
+	for ( ; from < to ; from++)
+		map[from>>3] |= 1 << (from&7);
+}
+
+static int data_blocks(struct node * n)
+{
+	if (n->link || !(S_ISREG(n->st.st_mode) || S_ISDIR(n->st.st_mode)))
+		return 0;
+	if (S_ISDIR(n->st.st_mode))
+		return (n->entries*sizeof (struct dir_entry) + BLOCK_SIZE-1) /
+			BLOCK_SIZE;
+	return (n->st.st_size + BLOCK_SIZE-1) / BLOCK_SIZE;
+}
+
+/* the data blocks of a file and its indirect blocks */
+static int all_blocks(int n)
+{
+	int i = n;
+
+	if (n > 7)
+		i++;
+	if (n > 7+512)
+		i += 1 + (n-7-512+511)/512;
+	return i;
+}
+
+/* the first name of the file 'n' is a hard link to, if it's been seen */
+static struct node * find_link(struct node * n)
+{
+	int i;
+
+	for (i=0 ; i<nr_links ; i++)
+		if (links[i]->st.st_dev == n->st.st_dev &&
+		    links[i]->st.st_ino == n->st.st_ino)
+			return links[i];
+	if (!(links = realloc(links,(nr_links+1)*sizeof (struct node *))))
+		die("out of memory");
+	links[nr_links++] = n;
+	return NULL;
+}
+
+static struct node * scan(const char * path, const char * name,
+	struct node * parent, int * blocks)
+{
+	struct node * n, * c, ** p;
+	struct dirent * de;
+	DIR * dir;
+
+	if (!(n = calloc(1,sizeof (struct node))) || !(n->path = strdup(path)))
+		die("out of memory");
+	if (lstat(path,&n->st) < 0)
+		die("unable to stat file");
+	if (strlen(name) > NAME_LEN) {
+		fprintf(stderr,"packfs: %s: name too long\n",path);
+		exit(1);
+	}
+	strcpy(n->name,name);
+	n->parent = parent;
+	n->nlinks = S_ISDIR(n->st.st_mode) ? 2 : 1;
+	nr_nodes++;
+	if (!S_ISDIR(n->st.st_mode)) {
+		if (n->st.st_nlink > 1 && (n->link = find_link(n))) {
+			n->link->nlinks++;
+			nr_nodes--;
+		}
+		*blocks += all_blocks(data_blocks(n));
+		return n;
+	}
+	n->entries = 2;
+	if (!(dir = opendir(path)))
+		die("unable to read directory");
+	while ((de = readdir(dir))) {
+		char sub[4096];
+		struct stat st;
+
+		if (!strcmp(de->d_name,".") || !strcmp(de->d_name,".."))
+			continue;
+		snprintf(sub,sizeof (sub),"%s/%s",path,de->d_name);
+		if (lstat(sub,&st) < 0 || S_ISLNK(st.st_mode) ||
+		    S_ISSOCK(st.st_mode)) {
+			fprintf(stderr,"packfs: %s: left out\n",sub);
+			continue;
+		}
+		c = scan(sub,de->d_name,n,blocks);
+		for (p = &n->child ; *p && strcmp((*p)->name,c->name) < 0 ;
+		     p = &(*p)->next)
+			/* nothing */ ;
+		c->next = *p;
+		*p = c;
+		n->entries++;
+		if (S_ISDIR(c->st.st_mode))
+			n->nlinks++;
+	}
+	closedir(dir);
+	*blocks += all_blocks(data_blocks(n));
+	return n;
+}
+
+/* allocate the blocks of 'n', write its indirect blocks and its data */
+static void place_data(struct node * n)
+{
+	struct d_inode * inode = itable + n->ino-1;
+	unsigned short ind[512], dind[512];
+	char buf[BLOCK_SIZE];
+	int nr,b,ind_zone = 0,in = -1;
+
+	nr = data_blocks(n);
+	if (nr > MAX_BLOCKS)
+		die("file too big");
+	if (!(n->zones = malloc((nr+1)*sizeof (int))))
+		die("out of memory");
+	memset(dind,0,sizeof (dind));
+	if (S_ISREG(n->st.st_mode) && (in = open(n->path,O_RDONLY)) < 0)
+		die("unable to open file");
+	for (b=0 ; b<nr ; b++) {
+		if (b == 7) {
+			inode->i_zone[7] = ind_zone = next_zone++;
+			memset(ind,0,sizeof (ind));
+		} else if (b == 7+512)
+			inode->i_zone[8] = next_zone++;
+		if (b >= 7+512 && !((b-7-512) & 511)) {
+			write_block(ind_zone,ind);
+			dind[(b-7-512)>>9] = ind_zone = next_zone++;
+			memset(ind,0,sizeof (ind));
+		}
+		n->zones[b] = next_zone++;
+		if (b < 7)
+			inode->i_zone[b] = n->zones[b];
+		else
+			ind[(b-7) & 511] = n->zones[b];
+		if (in >= 0) {
+			memset(buf,0,BLOCK_SIZE);
+			if (read(in,buf,BLOCK_SIZE) < 0)
+				die("read failed");
+			write_block(n->zones[b],buf);
+		}
+	}
+	if (ind_zone)
+		write_block(ind_zone,ind);
+	if (inode->i_zone[8])
+		write_block(inode->i_zone[8],dind);
+	if (in >= 0)
+		close(in);
+}
+
+static void place(struct node * n)
+{
+	struct d_inode * inode;
+
+	if (n->link)
+		n = n->link;
+	if (n->ino)
+		return;
+	if (n->parent)
+		place(n->parent);
+	n->ino = next_ino++;
+	inode = itable + n->ino-1;
+	inode->i_mode = n->st.st_mode;
+	inode->i_uid = n->st.st_uid;
+	inode->i_gid = n->st.st_gid;
+	inode->i_time = n->st.st_mtime;
+	inode->i_nlinks = n->nlinks;
+	if (S_ISDIR(n->st.st_mode))
+		inode->i_size = n->entries * sizeof (struct dir_entry);
+	else if (S_ISREG(n->st.st_mode))
+		inode->i_size = n->st.st_size;
+	else if (S_ISCHR(n->st.st_mode) || S_ISBLK(n->st.st_mode))
+		inode->i_zone[0] = (major(n->st.st_rdev) << 8) |
+			minor(n->st.st_rdev);
+	place_data(n);
+}
+
+/* the directory first, then its files, then its subdirectories */
+static void place_tree(struct node * n)
+{
+	struct node * c;
+
+	place(n);
+	for (c = n->child ; c ; c = c->next)
+		if (!S_ISDIR(c->st.st_mode))
+			place(c);
+	for (c = n->child ; c ; c = c->next)
+		if (S_ISDIR(c->st.st_mode))
+			place_tree(c);
+}
+
+static struct node * lookup(struct node * root, char * path)
+{
+	struct node * n = root;
+	char * name;
+
+	for (name = strtok(path,"/") ; name && n ; name = strtok(NULL,"/"))
+		for (n = n->child ; n && strcmp(n->name,name) ; n = n->next)
+			/* nothing */ ;
+	return n;
+}
+
+static void place_trace(struct node * root, const char * trace)
+{
+	char line[4096];
+	struct node * n;
+	FILE * f;
+
+	if (!(f = fopen(trace,"r")))
+		die("unable to open trace");
+	while (fgets(line,sizeof (line),f)) {
+		line[strcspn(line,"\r\n")] = 0;
+		if ((n = lookup(root,line)))
+			place(n);
+	}
+	fclose(f);
+}
+
+static void write_dirs(struct node * n)
+{
+	struct dir_entry de[BLOCK_SIZE/sizeof (struct dir_entry)];
+	struct node * c;
+	int i = 2,b = 0;
+
+	if (!S_ISDIR(n->st.st_mode))
+		return;
+	memset(de,0,sizeof (de));
+	de[0].inode = n->ino;
+	strcpy(de[0].name,".");
+	de[1].inode = n->parent ? n->parent->ino : n->ino;
+	strcpy(de[1].name,"..");
+	for (c = n->child ; ; c = c->next) {
+		if (i == BLOCK_SIZE/sizeof (struct dir_entry) || !c) {
+			write_block(n->zones[b++],de);
+			memset(de,0,sizeof (de));
+			i = 0;
+		}
+		if (!c)
+			break;
+		de[i].inode = c->link ? c->link->ino : c->ino;
+		memcpy(de[i++].name,c->name,strlen(c->name));
+		write_dirs(c);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	struct d_super_block sb;
+	struct node * root;
+	unsigned char * map;
+	char * trace = NULL;
+	int blocks = 0,inodes = 0,need = 0,first,imap,zmap,i,c;
+
+	while ((c = getopt(argc,argv,"t:b:i:")) != -1)
+		switch (c) {
+			case 't': trace = optarg; break;
+			case 'b': blocks = atoi(optarg); break;
+			case 'i': inodes = atoi(optarg); break;
+			default: die("usage: packfs [-t trace] [-b blocks] "
+				"[-i inodes] directory image");
+		}
+	if (argc - optind != 2)
+		die("usage: packfs [-t trace] [-b blocks] [-i inodes] "
+			"directory image");
+	root = scan(argv[optind],"",NULL,&need);
+	if (!S_ISDIR(root->st.st_mode))
+		die("not a directory");
+	if (!inodes)
+		inodes = nr_nodes + nr_nodes/4 + 16;
+	if (inodes < nr_nodes || inodes > 0xffff)
+		die("bad number of inodes");
+	inodes = (inodes + INODES_PER_BLOCK-1) & ~(INODES_PER_BLOCK-1);
+	if (inodes > 0xffff)
+		inodes -= INODES_PER_BLOCK;
+	imap = (inodes + 1 + 8191) / 8192;
+	if (!blocks)
+		blocks = 2 + imap + inodes/INODES_PER_BLOCK + 8 + need +
+			need/10 + 16;
+	zmap = (blocks + 8191) / 8192;
+	first = 2 + imap + zmap + inodes/INODES_PER_BLOCK;
+	if (blocks > 0xffff || blocks < first + need)
+		die("bad number of blocks");
+	if (!(itable = calloc(inodes,sizeof (struct d_inode))))
+		die("out of memory");
+	if ((fd = open(argv[optind+1],O_RDWR|O_CREAT|O_TRUNC,0666)) < 0)
+		die("unable to create image");
+	next_zone = first;
+	place(root);
+	if (trace)
+		place_trace(root,trace);
+	place_tree(root);
+	write_dirs(root);
+	if (!(map = calloc(imap+zmap,BLOCK_SIZE)))
+		die("out of memory");
+	set_bits(map,0,next_ino);
+	set_bits(map,inodes+1,imap*8192);
+	set_bits(map+imap*BLOCK_SIZE,0,next_zone-first+1);
+	set_bits(map+imap*BLOCK_SIZE,blocks-first+1,zmap*8192);
+	for (i=0 ; i<imap+zmap ; i++)
+		write_block(2+i,map+i*BLOCK_SIZE);
+	for (i=0 ; i < inodes/INODES_PER_BLOCK ; i++)
+		write_block(2+imap+zmap+i,itable+i*INODES_PER_BLOCK);
+	memset(&sb,0,sizeof (sb));
+	sb.s_ninodes = inodes;
+	sb.s_nzones = blocks;
+	sb.s_imap_blocks = imap;
+	sb.s_zmap_blocks = zmap;
+	sb.s_firstdatazone = first;
+	sb.s_log_zone_size = 0;
+	sb.s_max_size = MAX_BLOCKS*BLOCK_SIZE;
+	sb.s_magic = SUPER_MAGIC;
+	memset(map,0,BLOCK_SIZE);
+	memcpy(map,&sb,sizeof (sb));
+	write_block(1,map);
+	memset(map,0,BLOCK_SIZE);
+	write_block(0,map);
+	if (lseek(fd,(off_t) blocks*BLOCK_SIZE-1,SEEK_SET) < 0 ||
+	    write(fd,"",1) != 1)
+		die("write failed");
+	close(fd);
+	fprintf(stderr,"%d/%d blocks, %d/%d inodes\n",next_zone,blocks,
+		next_ino-1,inodes);
+	return 0;
+}